@@ -1,7 +1,11 @@
 #ifndef PROTOWORK_HPP
 #define PROTOWORK_HPP
 
+#include <cstdint>
+#include <functional>
 #include <memory>
+#include <optional>
+#include <string>
 #include <unordered_map>
 #include <vector>
 
@@ -9,8 +13,12 @@
 #include <glm/glm.hpp>
 
 #include <protowork/input.hpp>
+#include <protowork/loader.hpp>
+#include <protowork/replay.hpp>
 #include <protowork/world.hpp>
+#include <protowork/world/pick.hpp>
 #include <protowork/ui.hpp>
+#include <protowork/renderer.hpp>
 
 struct GLFWwindow;
 
@@ -21,6 +29,29 @@ struct app_t {
         std::size_t width;
         std::size_t height;
         const char *title;
+        // render on a dedicated thread owning the GL context
+        bool threaded_rendering = false;
+        // when set, the input of every frame is written to this file
+        const char *record_input = nullptr;
+        // when set, input is read from this file instead of the window,
+        // one recorded frame per update(), and should_close() turns true
+        // after its last frame
+        const char *replay_input = nullptr;
+        // collects frame_stats(); always on while replaying input
+        bool frame_stats = false;
+
+        // seconds simulated by each update()
+        double timestep = 1.0 / 60.0;
+        vsync_t vsync = vsync_t::ON;
+        // run() sleeps between frames to stay below this rate; 0 disables
+        double max_fps = 0.0;
+        // run() draws only when input, the camera, the models or the window
+        // size changed, or after request_redraw()
+        bool on_demand = false;
+
+        // see render_options_t
+        bool depth_prepass = false;
+        bool occlusion_culling = false;
     };
     explicit app_t(config_t const &);
     explicit app_t(std::size_t width, std::size_t height, const char *title)
@@ -28,17 +59,79 @@ struct app_t {
 
     ~app_t();
 
+    // advances the simulation by one fixed timestep
     void update();
-    void draw() const;
+    void draw();
+
+    // runs until should_close(): update() and then `step` are called once
+    // per elapsed timestep, and frames show the world interpolated between
+    // the last two steps. replayed sessions run one step per frame.
+    void run(std::function<void(double dt)> const &step = {});
+
+    // makes the next frame of an on-demand run() draw, e.g. after texts
+    // changed
+    void request_redraw() { m_redraw = true; }
 
     bool should_close() const;
+    // makes should_close() true, e.g. to end run() from its step
+    void close();
+
+    // label or model under the mouse cursor as of the last update()
+    std::optional<world::pick_result_t> pick();
+
+    // writes the next drawn frame to a PNG file. frames are read back
+    // without stalling and encoded on a background thread, so the file is
+    // complete a few frames later. encoding errors are rethrown by a later
+    // draw(), after which drawing can go on.
+    void capture(std::string const &path);
+    // appends every drawn frame to a Y4M video until stop_recording()
+    void start_recording(std::string const &path, int fps = 60);
+    void stop_recording() { m_recording.reset(); }
+
+    // durations between successive frames; empty unless enabled in
+    // config_t
+    frame_stats_t const &frame_stats() const { return m_frame_stats; }
+
+    // loads models, fonts and shaders in the background
+    loader_t &loader() { return *m_loader; }
 
     world_t world;
     ui_t ui;
 
 private:
     GLFWwindow *m_window = nullptr;
+    detail::event_queue_t m_events;
     input_t m_input;
+    std::unique_ptr<input_recorder_t> m_recorder;
+    std::unique_ptr<input_player_t> m_player;
+    bool m_replay_finished = false;
+    bool m_collect_frame_stats;
+    frame_stats_t m_frame_stats;
+    double m_last_draw = -1.0;
+
+    void draw(double alpha);
+    bool needs_redraw();
+    void save_transforms();
+    // returns whether the snapshot differs from the latest step
+    bool interpolate(snapshot_t &, double alpha) const;
+
+    double m_timestep;
+    double m_max_fps;
+    bool m_on_demand;
+    bool m_redraw = true;
+    std::uint64_t m_drawn_version = 0;
+    matrix_t m_drawn_view = matrix_t(1.f);
+    int m_drawn_width = 0;
+    int m_drawn_height = 0;
+    detail::capture_targets_t m_pending_captures;
+    std::shared_ptr<detail::capture_target_t> m_recording;
+    std::vector<handle_t> m_previous_handles;
+    std::vector<matrix_t> m_previous_transforms;
+    world::picker_t m_picker;
+    snapshot_t m_snapshot;
+    std::unique_ptr<loader_t> m_loader;
+    std::unique_ptr<renderer_t> m_renderer;
+    std::unique_ptr<detail::render_thread_t> m_render_thread;
 };
 
 } // namespace protowork
@@ -0,0 +1,59 @@
+#ifndef PROTOWORK_ARENA_HPP
+#define PROTOWORK_ARENA_HPP
+
+#include <cstddef>
+#include <memory_resource>
+#include <vector>
+
+namespace protowork::detail {
+
+// linear allocator for data living no longer than a frame, e.g. as the
+// resource of std::pmr containers. allocation bumps a pointer and
+// deallocation does nothing; reset() frees everything at once. blocks are
+// kept across resets, and when a frame needed more than one they are
+// replaced by a single block of their total size, so frames of steady size
+// never allocate. it is not thread safe.
+struct frame_arena_t final : std::pmr::memory_resource {
+    static constexpr std::size_t BLOCK_SIZE = 64 * 1024;
+
+    explicit frame_arena_t(
+        std::pmr::memory_resource *upstream = std::pmr::new_delete_resource());
+    ~frame_arena_t();
+    frame_arena_t(frame_arena_t const &) = delete;
+    frame_arena_t &operator=(frame_arena_t const &) = delete;
+
+    // invalidates every allocation
+    void reset();
+
+    // bytes allocated since reset()
+    std::size_t used() const { return m_used; }
+    // bytes of all blocks
+    std::size_t capacity() const;
+    // blocks requested from the upstream resource so far
+    std::size_t upstream_allocations() const { return m_n_upstream; }
+
+private:
+    struct block_t {
+        std::byte *data;
+        std::size_t size;
+    };
+
+    void *do_allocate(std::size_t bytes, std::size_t alignment) override;
+    void do_deallocate(void *, std::size_t, std::size_t) override {}
+    bool do_is_equal(memory_resource const &other) const noexcept override {
+        return this == &other;
+    }
+
+    void add_block(std::size_t size);
+    void release();
+
+    std::pmr::memory_resource *m_upstream;
+    std::vector<block_t> m_blocks; // the last one is being filled
+    std::size_t m_offset = 0;      // in the last block
+    std::size_t m_used = 0;
+    std::size_t m_n_upstream = 0;
+};
+
+} // namespace protowork::detail
+
+#endif
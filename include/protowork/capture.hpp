@@ -0,0 +1,96 @@
+#ifndef PROTOWORK_CAPTURE_HPP
+#define PROTOWORK_CAPTURE_HPP
+
+#include <array>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <exception>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <protowork/util.hpp>
+
+namespace protowork::detail {
+
+// destination of captured frames. frames are RGBA rows from bottom to top,
+// as GL reads them; targets are written only by the encoder thread.
+struct capture_target_t {
+    virtual ~capture_target_t() = default;
+    virtual void write(int width, int height, std::uint8_t const *rgba) = 0;
+};
+
+// the file is created immediately; both throw std::runtime_error when it
+// cannot be
+std::shared_ptr<capture_target_t> make_png_target(std::string const &path);
+std::shared_ptr<capture_target_t> make_y4m_target(std::string const &path,
+                                                  int fps);
+
+using capture_targets_t = std::vector<std::shared_ptr<capture_target_t>>;
+
+// reads frames back into a ring of pixel buffer objects without waiting for
+// the GPU. a fence marks each readback; once it signaled the pixels are
+// copied out and encoded on a background thread. at most MAX_JOBS frames
+// wait for the encoder; beyond that, reading back waits for it. it must be
+// used on the thread owning the GL context.
+struct frame_capture_t {
+    explicit frame_capture_t();
+    // waits for pending readbacks and encodes everything queued
+    ~frame_capture_t();
+    frame_capture_t(frame_capture_t const &) = delete;
+    frame_capture_t &operator=(frame_capture_t const &) = delete;
+
+    // reads the frame just drawn into the read buffer; the size is that of
+    // the framebuffer in pixels
+    void read(int width, int height, capture_targets_t const &);
+    // hands finished readbacks to the encoder; with `wait`, all of them
+    void poll(bool wait);
+
+    // rethrows an exception raised while encoding
+    void rethrow_if_failed();
+
+private:
+    static constexpr std::size_t N_SLOTS = 3;
+    // frames read back but not yet encoded
+    static constexpr std::size_t MAX_JOBS = 4;
+
+    struct slot_t {
+        id_t buffer_id = 0;
+        std::size_t capacity = 0;
+        GLsync fence = nullptr;
+        int width = 0;
+        int height = 0;
+        capture_targets_t targets;
+    };
+    struct job_t {
+        capture_targets_t targets;
+        int width;
+        int height;
+        std::vector<std::uint8_t> pixels;
+    };
+
+    // returns false when the oldest readback is not finished and !wait
+    bool retire_oldest(bool wait);
+    void run_encoder();
+
+    std::array<slot_t, N_SLOTS> m_slots;
+    std::size_t m_head = 0; // oldest pending slot
+    std::size_t m_n_pending = 0;
+
+    std::mutex m_mutex;
+    std::condition_variable m_condition;
+    std::condition_variable m_dequeued;
+    std::deque<job_t> m_jobs;
+    // pixel storage handed back by the encoder for reuse
+    std::vector<std::vector<std::uint8_t>> m_free;
+    bool m_stop = false;
+    std::exception_ptr m_error;
+    std::thread m_encoder;
+};
+
+} // namespace protowork::detail
+
+#endif
@@ -0,0 +1,96 @@
+#ifndef PROTOWORK_COMMAND_HPP
+#define PROTOWORK_COMMAND_HPP
+
+#include <cstdint>
+#include <unordered_map>
+#include <vector>
+
+#include <protowork/util.hpp>
+#include <protowork/world/model.hpp>
+
+namespace protowork {
+
+// sort key layout (most significant first):
+//   [63:60] pass  [59:32] state  [31:0] depth or pass local order
+// opaque models use material_t::sort_state() as state, so draws sharing a
+// program and texture are adjacent and sorted front to back among
+// themselves.
+// packets are replayed in ascending key order, so packets sharing a pass and
+// state are adjacent and their state is bound once.
+namespace sort_key {
+enum pass_t : std::uint64_t { OPAQUE = 0, OVERLAY = 1 };
+
+constexpr std::uint64_t make(pass_t pass, std::uint32_t state,
+                             std::uint32_t order) {
+    return (std::uint64_t{pass} << 60) |
+           (std::uint64_t{state & 0x0fffffffu} << 32) | order;
+}
+
+// maps non-negative view depth to an order which preserves front to back
+std::uint32_t depth_order(float depth);
+} // namespace sort_key
+
+// backend-neutral draw request; it only refers to protowork objects, the
+// backend translates them to API calls while replaying.
+struct draw_packet_t {
+    enum class kind_t : std::uint8_t { MODEL, TEXT };
+
+    std::uint64_t key;
+    kind_t kind;
+
+    // MODEL
+    world::model_t const *model;
+    world::geometry_t const *geometry;
+    std::uint64_t revision;
+    matrix_t model_matrix;
+    world::material_t const *material;
+
+    // TEXT
+    int font_size;
+    glm::vec2 const *vertices;
+    glm::vec2 const *uvs;
+    std::size_t vertex_count;
+};
+
+// packets recorded by a single thread. lists are cleared, not freed, between
+// frames so steady-state recording does not allocate.
+struct command_list_t {
+    void clear();
+
+    void draw_model(std::uint64_t key, world::model_t const *,
+                    world::geometry_t const *, std::uint64_t revision,
+                    matrix_t const &, world::material_t const *);
+
+    struct text_batch_t {
+        std::vector<glm::vec2> vertices;
+        std::vector<glm::vec2> uvs;
+    };
+
+    // text quads are accumulated per font size; finish() turns each
+    // non-empty batch into a single TEXT packet
+    text_batch_t &text_batch(int font_size);
+    void finish();
+
+    // bytes reserved by the packets and text batches
+    std::size_t capacity_bytes() const;
+
+    std::vector<draw_packet_t> packets;
+
+private:
+    std::unordered_map<int, text_batch_t> m_text_batches;
+};
+
+struct sorted_packet_t {
+    std::uint64_t key;
+    draw_packet_t const *packet;
+};
+
+// merges the packets of all lists and sorts them by key with an LSD radix
+// sort, skipping byte positions in which all keys agree
+void sort_packets(std::vector<command_list_t> const &,
+                  std::vector<sorted_packet_t> &order,
+                  std::vector<sorted_packet_t> &scratch);
+
+} // namespace protowork
+
+#endif
@@ -1,11 +1,12 @@
 #ifndef PROTOWORK_FONT_HPP
 #define PROTOWORK_FONT_HPP
 
+#include <cstdint>
+#include <memory_resource>
 #include <unordered_map>
+#include <vector>
 #include <protowork/util.hpp>
 
-struct GLFWwindow;
-
 namespace protowork::font {
 
 struct key_t {
@@ -26,6 +27,8 @@ struct char_info_t {
 
 struct data_t {
     std::unordered_map<int, char_info_t> char_infos;
+    // 0 while evicted. it changes under the lock of get(), so only the GL
+    // thread may read it outside get().
     id_t texture_id;
     int atlas_width;
     int atlas_height;
@@ -35,11 +38,45 @@ void initialize();
 void finalize();
 void before_drawing();
 
-void render(GLFWwindow *window, int font_size,
-            std::vector<glm::vec2> const &vertices,
-            std::vector<glm::vec2> const &uvs);
+void render(int screen_width, int screen_height, int font_size,
+            glm::vec2 const *vertices, glm::vec2 const *uvs,
+            std::size_t count);
 
+// creates the glyph atlas on first use, which requires the GL context.
+// lookups of already created atlases may run on any thread.
 data_t const &get(key_t const &);
+// returns nullptr until get() created the atlas; may run on any thread
+data_t const *find(key_t const &);
+
+// GPU bytes of the atlas texture
+std::uint64_t atlas_bytes(data_t const &);
+// call once per frame on the GL thread after drawing. while the textures
+// of all atlases exceed `budget` bytes, the least recently used atlas not
+// drawn since the previous call loses its texture; get() rasterizes it
+// again when needed. metrics stay valid. scratch memory comes from
+// `resource`.
+void evict(std::uint64_t budget, std::pmr::memory_resource *resource =
+                                     std::pmr::get_default_resource());
+
+namespace detail {
+
+// glyph atlas rasterized on the CPU, before it has a texture
+struct atlas_t {
+    data_t data;
+    std::vector<std::uint8_t> pixels; // coverage, one byte per texel
+};
+
+// may run on any thread; calls are serialized on the shared face
+atlas_t rasterize(key_t const &);
+// creates the texture without binding it, so it may run on any context
+// sharing objects with the renderer's
+void upload(atlas_t &);
+// publishes an uploaded atlas and returns the published one. when the key
+// was published meanwhile, the atlas's texture is deleted on the calling
+// thread's context.
+data_t const &insert(key_t const &, atlas_t &&);
+
+} // namespace detail
 
 } // namespace protowork::font
 
@@ -0,0 +1,42 @@
+#ifndef PROTOWORK_GL_HPP
+#define PROTOWORK_GL_HPP
+
+#include <cstdint>
+#include <protowork/util.hpp>
+
+// state tracker for the GL context owned by the renderer. all protowork
+// rendering binds objects and toggles capabilities through these functions,
+// which skip calls that would not change the current state. the tracker is
+// not synchronized and must only be used on the thread owning the context.
+namespace protowork::gl {
+
+struct stats_t {
+    std::uint64_t issued = 0;
+    std::uint64_t elided = 0;
+};
+
+// counters of state calls issued to and elided from the driver. they may be
+// read from any thread.
+stats_t stats();
+void reset_stats();
+
+// forgets all cached state, e.g. after GL calls made outside protowork
+void invalidate();
+
+void use_program(id_t);
+void bind_vertex_array(id_t);
+void bind_array_buffer(id_t);
+void bind_texture_2d(GLuint unit, id_t);
+void set_capability(GLenum, bool enabled);
+void blend_func(GLenum src, GLenum dst);
+
+// delete objects and drop them from the cache, since GL may hand out the
+// same names again, and from memory accounting
+void delete_program(id_t);
+void delete_vertex_arrays(GLsizei, id_t const *);
+void delete_buffers(GLsizei, id_t const *);
+void delete_textures(GLsizei, id_t const *);
+
+} // namespace protowork::gl
+
+#endif
@@ -1,8 +1,30 @@
 #ifndef PROTOWORK_INPUT_HPP
 #define PROTOWORK_INPUT_HPP
 
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
 namespace protowork {
 
+// input event as delivered by GLFW, stamped with glfwGetTime() when it
+// arrived
+struct event_t {
+    enum class kind_t : std::uint8_t { MOUSE_MOVE, MOUSE_BUTTON, SCROLL, KEY };
+    // same values as GLFW_RELEASE, GLFW_PRESS and GLFW_REPEAT
+    enum class action_t : std::uint8_t { RELEASE, PRESS, REPEAT };
+
+    kind_t kind;
+    action_t action; // MOUSE_BUTTON, KEY
+    int code;        // mouse button or GLFW key code
+    int mods;        // GLFW modifier bits
+    double x;        // MOUSE_MOVE position, SCROLL offset
+    double y;
+    double time; // seconds
+};
+
 struct input_t {
     struct mouse_t {
         enum button_t { LEFT = 0, RIGHT, MIDDLE, N_BUTTONS };
@@ -10,9 +32,61 @@ struct input_t {
         double x = 0.0;
         double y = 0.0;
         button_state_t buttons[button_t::N_BUTTONS] = {};
+        // scroll offset accumulated over the frame
+        double scroll_x = 0.0;
+        double scroll_y = 0.0;
     } mouse;
+
+    struct keyboard_t {
+        // GLFW key codes are below this
+        static constexpr int N_KEYS = 512;
+        using key_state_t = mouse_t::button_state_t;
+        key_state_t keys[N_KEYS] = {};
+
+        bool is_down(int key) const {
+            return key >= 0 && key < N_KEYS &&
+                   keys[key] != key_state_t::RELEASED;
+        }
+    } keyboard;
+
+    // seconds; glfwGetTime() when the frame's input was taken, or the
+    // fixed-step virtual time while replaying
+    double time = 0.0;
+
+    // every event since the previous frame in arrival order. the states
+    // above only hold the end of the frame; consumers which must not miss
+    // short clicks or intermediate cursor positions read the events.
+    std::vector<event_t> events;
+
+    // applies events to the states. buttons and keys pressed during the
+    // frame are PUSHED, those held since before it are PRESSED.
+    void begin_frame();
+    void apply(event_t const &);
 };
 
+namespace detail {
+
+// lock-free single-producer single-consumer ring of events. window callbacks
+// push, the frame update pops. when full, new events are dropped and
+// counted.
+struct event_queue_t {
+    static constexpr std::size_t CAPACITY = 1024;
+
+    bool push(event_t const &);
+    bool pop(event_t &);
+    std::uint64_t dropped() const {
+        return m_dropped.load(std::memory_order_relaxed);
+    }
+
+private:
+    std::array<event_t, CAPACITY> m_events;
+    alignas(64) std::atomic<std::size_t> m_head = 0; // next to pop
+    alignas(64) std::atomic<std::size_t> m_tail = 0; // next to push
+    std::atomic<std::uint64_t> m_dropped = 0;
+};
+
+} // namespace detail
+
 } // namespace protowork
 
 #endif
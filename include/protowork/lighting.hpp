@@ -0,0 +1,68 @@
+#ifndef PROTOWORK_LIGHTING_HPP
+#define PROTOWORK_LIGHTING_HPP
+
+#include <cstdint>
+#include <vector>
+
+#include <protowork/util.hpp>
+#include <protowork/world/light.hpp>
+
+namespace protowork::detail {
+
+// uniforms of programs shading with clustered lights
+struct cluster_params_t {
+    glm::uvec3 count = glm::uvec3{1};
+    // slice of view depth d is floor(log(d) * scale + bias)
+    float depth_scale = 0.f;
+    float depth_bias = 0.f;
+    glm::vec2 screen_size = glm::vec2{1.f};
+    glm::vec3 light_direction = glm::vec3{0.f, 0.f, -1.f}; // view space
+    glm::vec3 light_color = glm::vec3{0.f};
+};
+
+// clustered forward lighting. the view volume is split into tiles on the
+// screen and exponentially growing depth slices; every point light is
+// binned on the CPU into the clusters its sphere touches. lights, the
+// per-cluster ranges and the light index list are stored in shader storage
+// buffers 0, 1 and 2, so a fragment shades only the lights of its cluster.
+struct light_clusters_t {
+    static constexpr std::uint32_t TILES_X = 16;
+    static constexpr std::uint32_t TILES_Y = 9;
+    static constexpr std::uint32_t SLICES = 24;
+
+    explicit light_clusters_t() = default;
+    ~light_clusters_t();
+    light_clusters_t(light_clusters_t const &) = delete;
+    light_clusters_t &operator=(light_clusters_t const &) = delete;
+
+    // bins the lights and uploads the buffers (GL thread)
+    void build(std::vector<world::point_light_t> const &,
+               world::directional_light_t const &,
+               matrix_t const &projection, matrix_t const &view,
+               int screen_width, int screen_height);
+    // binds the buffers to their binding points
+    void bind() const;
+
+    cluster_params_t const &params() const { return m_params; }
+
+private:
+    struct gpu_light_t {
+        glm::vec4 position_radius; // view space
+        glm::vec4 color;           // premultiplied by intensity
+    };
+
+    cluster_params_t m_params;
+    std::vector<gpu_light_t> m_lights;
+    // (cluster, light) pairs, sorted into m_indices by cluster
+    std::vector<std::uint64_t> m_pairs;
+    std::vector<glm::uvec2> m_ranges; // offset and count per cluster
+    std::vector<std::uint32_t> m_indices;
+
+    id_t m_light_buffer_id = 0;
+    id_t m_range_buffer_id = 0;
+    id_t m_index_buffer_id = 0;
+};
+
+} // namespace protowork::detail
+
+#endif
@@ -0,0 +1,139 @@
+#ifndef PROTOWORK_LOADER_HPP
+#define PROTOWORK_LOADER_HPP
+
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <protowork/font.hpp>
+#include <protowork/util.hpp>
+#include <protowork/world/model.hpp>
+
+struct GLFWwindow;
+
+namespace protowork {
+
+namespace detail {
+
+template <typename T> struct resource_state_t {
+    void set_value(std::shared_ptr<T> value) {
+        std::lock_guard lock{mutex};
+        this->value = std::move(value);
+        done = true;
+        condition.notify_all();
+    }
+    void set_error(std::exception_ptr error) {
+        std::lock_guard lock{mutex};
+        this->error = error;
+        done = true;
+        condition.notify_all();
+    }
+
+    std::mutex mutex;
+    std::condition_variable condition;
+    bool done = false;
+    std::shared_ptr<T> value;
+    std::exception_ptr error;
+};
+
+} // namespace detail
+
+// future-like handle of an asset loaded in the background. it becomes ready
+// once the asset is resident, i.e. its GPU objects are complete and may be
+// used by the renderer, or when loading failed.
+template <typename T> struct resource_t {
+    bool ready() const {
+        std::lock_guard lock{m_state->mutex};
+        return m_state->done;
+    }
+    void wait() const {
+        std::unique_lock lock{m_state->mutex};
+        m_state->condition.wait(lock, [&] { return m_state->done; });
+    }
+    // waits until ready; rethrows the error loading failed with
+    std::shared_ptr<T> const &get() const {
+        wait();
+        if (m_state->error)
+            std::rethrow_exception(m_state->error);
+        return m_state->value;
+    }
+
+private:
+    friend struct loader_t;
+    std::shared_ptr<detail::resource_state_t<T>> m_state =
+        std::make_shared<detail::resource_state_t<T>>();
+};
+
+// loads assets off the frame. files are read and decoded by a pool of
+// workers, and GPU objects are created on a hidden context sharing objects
+// with the window's. each upload is followed by a fence; the handle becomes
+// ready once the fence signaled, typically a few frames later.
+//
+// it must be created and destroyed on the main thread, before the window's
+// context is made current on another thread.
+struct loader_t {
+    explicit loader_t(GLFWwindow *share, std::size_t worker_count = 2);
+    ~loader_t();
+    loader_t(loader_t const &) = delete;
+    loader_t &operator=(loader_t const &) = delete;
+
+    // Wavefront OBJ or PLY file with at most 65536 vertices; larger meshes
+    // are converted to .pwm and drawn by world::mapped_model_t
+    resource_t<world::model_t> load_model(std::string path);
+    // glyph atlas which font::get() and font::find() return once ready
+    resource_t<font::data_t const> load_font(int font_size);
+    // program linked from GLSL source files
+    resource_t<id_t const> load_shader(std::string vertex_path,
+                                       std::string fragment_path);
+
+private:
+    // a job runs in three steps: decode on a worker, upload on the loader's
+    // context and complete after its fence signaled
+    using complete_t = std::function<void()>;
+    using upload_t = std::function<complete_t()>;
+    using decode_t = std::function<upload_t()>;
+    using fail_t = std::function<void(std::exception_ptr)>;
+
+    struct job_t {
+        decode_t decode;
+        fail_t fail;
+    };
+    struct upload_job_t {
+        upload_t upload;
+        fail_t fail;
+    };
+    struct fenced_job_t {
+        GLsync fence;
+        complete_t complete;
+        fail_t fail;
+    };
+
+    template <typename T>
+    resource_t<T> submit(std::function<std::function<std::shared_ptr<T>()>()>
+                             decode);
+
+    void run_worker();
+    void run_uploader();
+
+    GLFWwindow *m_context = nullptr;
+    bool m_stop = false;
+    std::mutex m_mutex;
+    std::condition_variable m_job_condition;
+    std::condition_variable m_upload_condition;
+    std::deque<job_t> m_jobs;
+    std::deque<upload_job_t> m_uploads;
+    // owned by the uploader thread
+    std::deque<fenced_job_t> m_fenced;
+    std::vector<std::thread> m_workers;
+    std::thread m_uploader;
+};
+
+} // namespace protowork
+
+#endif
@@ -0,0 +1,69 @@
+#ifndef PROTOWORK_MEMORY_HPP
+#define PROTOWORK_MEMORY_HPP
+
+#include <array>
+#include <cstdint>
+#include <vector>
+
+#include <protowork/util.hpp>
+
+// accounting of the memory protowork allocates. every buffer and texture it
+// creates is tracked with its size and owner, as are larger host
+// allocations. all functions may be called from any thread.
+namespace protowork::memory {
+
+enum category_t : std::uint8_t {
+    GEOMETRY,   // model vertex and index data
+    FONT_ATLAS, // glyph atlases
+    FRAME,      // rewritten every frame: text vertices, lights, commands
+    READBACK,   // frame capture and depth pyramid
+    N_CATEGORIES
+};
+
+enum class location_t : std::uint8_t { GPU, HOST };
+
+struct usage_t {
+    std::uint64_t bytes = 0;
+    std::uint64_t peak = 0;    // since the start or reset_peaks()
+    std::uint64_t objects = 0; // tracked objects
+};
+
+struct stats_t {
+    std::array<usage_t, N_CATEGORIES> gpu;
+    std::array<usage_t, N_CATEGORIES> host;
+};
+
+stats_t stats();
+void reset_peaks();
+
+struct allocation_t {
+    location_t location;
+    category_t category;
+    char const *owner;
+    std::uint64_t bytes;
+};
+
+// every tracked object, e.g. to find the largest owners
+std::vector<allocation_t> allocations();
+
+// limit of GPU bytes of a category; 0, the default, is unlimited. renderers
+// evict least recently used font atlases and model geometry while their
+// category is over budget. evicted objects are recreated when drawn again.
+void set_budget(category_t, std::uint64_t bytes);
+std::uint64_t budget(category_t);
+
+// registration by protowork code. tracking an object again replaces its
+// size; `owner` must be a string literal. gl::delete_buffers() and
+// gl::delete_textures() untrack the objects they delete.
+void track_buffer(id_t, std::uint64_t bytes, category_t, char const *owner);
+void track_texture(id_t, std::uint64_t bytes, category_t, char const *owner);
+void untrack_buffer(id_t);
+void untrack_texture(id_t);
+// host memory is keyed by the object owning it
+void track_host(void const *key, std::uint64_t bytes, category_t,
+                char const *owner);
+void untrack_host(void const *key);
+
+} // namespace protowork::memory
+
+#endif
@@ -0,0 +1,113 @@
+#ifndef PROTOWORK_OCCLUSION_HPP
+#define PROTOWORK_OCCLUSION_HPP
+
+#include <array>
+#include <cstdint>
+#include <vector>
+
+#include <protowork/util.hpp>
+
+namespace protowork::detail {
+
+// hierarchical depth of a drawn frame on the CPU. texels of level k hold
+// the farthest window depth of the 2^k x 2^k level 0 texels they cover, so
+// a box whose nearest depth is farther than every texel under it is hidden.
+struct depth_pyramid_t {
+    bool empty() const { return m_levels.empty(); }
+
+    // replaces level 0 of a `width` x `height` pixel frame, `block` x
+    // `block` pixels per texel, and rebuilds the coarser levels. level 0
+    // takes the contents of `depth`, which receives the previous storage
+    // for reuse.
+    void assign(int width, int height, int block, std::vector<float> &depth,
+                matrix_t const &view_projection);
+
+    // whether the box (world space) is behind the depth of the frame.
+    // boxes crossing the near plane or the screen edges count as visible.
+    // it only reads, so workers may test concurrently.
+    bool is_occluded(aabb_t const &) const;
+    // the same for a screen-aligned rectangle at the depth of `anchor`,
+    // e.g. a label. `lo` and `hi` are its corners in NDC relative to the
+    // projected anchor.
+    bool is_occluded(pos_t const &anchor, glm::vec2 lo = glm::vec2{0.f},
+                     glm::vec2 hi = glm::vec2{0.f}) const;
+
+private:
+    struct level_t {
+        int width;
+        int height;
+        std::vector<float> depth;
+    };
+
+    float farthest(int level, int x0, int y0, int x1, int y1) const;
+    // whether window depth `nearest` is behind every texel under the NDC
+    // rectangle [lo, hi]
+    bool is_behind(glm::vec2 lo, glm::vec2 hi, float nearest) const;
+
+    std::vector<level_t> m_levels;
+    int m_pixel_width = 0;
+    int m_pixel_height = 0;
+    int m_block = 1;
+    matrix_t m_view_projection = matrix_t(1.f);
+};
+
+// builds a depth pyramid of every drawn frame for occlusion culling of the
+// following frames. the depth buffer, which may be multisampled, is
+// resolved into a single sample texture by a blit and reduced
+// on the GPU to one texel per BLOCK x BLOCK pixels, which is read back
+// through a ring of buffers without waiting for the GPU and expanded into
+// the coarser levels on the CPU. culling thus uses the depth of a frame
+// drawn one or a few frames before. it must be used on the thread owning
+// the GL context.
+struct hi_z_t {
+    static constexpr int BLOCK = 8;
+
+    // whether the depth buffer of the default framebuffer can be resolved,
+    // i.e. it has 24 depth and 8 stencil bits. requires a current context.
+    static bool is_supported();
+
+    explicit hi_z_t();
+    ~hi_z_t();
+    hi_z_t(hi_z_t const &) = delete;
+    hi_z_t &operator=(hi_z_t const &) = delete;
+
+    // reduces the depth buffer of the frame just drawn with
+    // `view_projection`. call it after opaque geometry was drawn; `width`
+    // and `height` are the size of the default framebuffer in pixels.
+    void build(int width, int height, matrix_t const &view_projection);
+
+    // latest frame read back; empty until the first one finished
+    depth_pyramid_t const &pyramid() const { return m_pyramid; }
+
+private:
+    static constexpr std::size_t N_SLOTS = 3;
+
+    struct slot_t {
+        id_t buffer_id = 0;
+        std::size_t capacity = 0;
+        GLsync fence = nullptr;
+        int width = 0; // in texels of level 0
+        int height = 0;
+        matrix_t view_projection;
+    };
+
+    // returns false when the oldest reduction is not finished
+    bool retire_oldest();
+
+    id_t m_program_id = 0;
+    GLint m_size_location = -1;
+    GLint m_texels_location = -1;
+    id_t m_framebuffer_id = 0; // with the depth texture attached
+    id_t m_depth_texture_id = 0;
+    int m_depth_width = 0;
+    int m_depth_height = 0;
+    std::array<slot_t, N_SLOTS> m_slots;
+    std::size_t m_head = 0; // oldest pending slot
+    std::size_t m_n_pending = 0;
+    std::vector<float> m_readback;
+    depth_pyramid_t m_pyramid;
+};
+
+} // namespace protowork::detail
+
+#endif
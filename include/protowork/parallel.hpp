@@ -0,0 +1,46 @@
+#ifndef PROTOWORK_PARALLEL_HPP
+#define PROTOWORK_PARALLEL_HPP
+
+#include <cstddef>
+#include <memory>
+#include <type_traits>
+
+namespace protowork::detail {
+
+// non-owning reference to a parallel_for body. unlike std::function it never
+// allocates, however large the captures of the referenced lambda are; the
+// callable must outlive the reference.
+struct chunk_fn_t {
+    template <typename F,
+              typename = std::enable_if_t<
+                  !std::is_same_v<std::decay_t<F>, chunk_fn_t>>>
+    chunk_fn_t(F &&fn)
+        : m_object{std::addressof(fn)},
+          m_call{[](void const *object, std::size_t begin, std::size_t end,
+                    std::size_t worker) {
+              (*static_cast<std::remove_reference_t<F> *>(
+                  const_cast<void *>(object)))(begin, end, worker);
+          }} {}
+
+    void operator()(std::size_t begin, std::size_t end,
+                    std::size_t worker) const {
+        m_call(m_object, begin, end, worker);
+    }
+
+private:
+    void const *m_object;
+    void (*m_call)(void const *, std::size_t, std::size_t, std::size_t);
+};
+
+// number of threads which may run a parallel_for body, including the caller
+std::size_t worker_count();
+
+// splits [0, count) into chunks of at least `grain` elements and calls
+// fn(begin, end, worker) for each of them on the worker pool. the calling
+// thread participates as worker 0 and the call blocks until all chunks are
+// done. when the pool is already busy the chunks run on the caller.
+void parallel_for(std::size_t count, std::size_t grain, chunk_fn_t fn);
+
+} // namespace protowork::detail
+
+#endif
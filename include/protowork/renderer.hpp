@@ -0,0 +1,189 @@
+#ifndef PROTOWORK_RENDERER_HPP
+#define PROTOWORK_RENDERER_HPP
+
+#include <array>
+#include <condition_variable>
+#include <cstdint>
+#include <exception>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include <protowork/arena.hpp>
+#include <protowork/capture.hpp>
+#include <protowork/util.hpp>
+#include <protowork/command.hpp>
+#include <protowork/lighting.hpp>
+#include <protowork/occlusion.hpp>
+#include <protowork/world.hpp>
+#include <protowork/ui.hpp>
+
+struct GLFWwindow;
+
+namespace protowork {
+
+// swap interval. ADAPTIVE syncs to vblank but swaps late frames immediately
+// instead of waiting for the next one; without driver support it is ON.
+enum class vsync_t { OFF, ON, ADAPTIVE };
+
+// immutable copy of world_t/ui_t state taken by the main thread at the end
+// of a frame. the renderer only reads snapshots, so simulation of the next
+// frame can run while the previous one is being rendered.
+struct snapshot_t {
+    // world.models.sync() must have been called for the frame
+    void capture(world_t const &, ui_t const &, int screen_width,
+                 int screen_height, bool publish_geometry);
+
+    int screen_width = 0;
+    int screen_height = 0;
+    matrix_t projection = matrix_t(1.f);
+    matrix_t view = matrix_t(1.f);
+
+    // models in structure-of-arrays layout, all indexed alike
+    std::vector<world::model_t const *> models;
+    std::vector<matrix_t> model_matrices;
+    std::vector<aabb_t> model_bounds; // model space
+    std::vector<std::uint64_t> model_revisions;
+    std::vector<world::material_t> model_materials;
+    // filled only when geometry is published for another thread; the
+    // owners keep models alive while the snapshot may still be rendered
+    std::vector<std::shared_ptr<world::geometry_t const>> model_geometries;
+    std::vector<std::shared_ptr<world::model_t const>> model_owners;
+
+    std::vector<ui::text2d_t> texts_2d;
+    std::vector<world::text3d_t> texts_3d;
+
+    std::vector<world::point_light_t> lights;
+    world::directional_light_t directional_light;
+
+    // the rendered frame is read back and written to these
+    detail::capture_targets_t captures;
+};
+
+// optional passes of the renderer
+struct render_options_t {
+    // draws opaque models into the depth buffer first, so that the shading
+    // pass shades only the nearest fragment of each pixel
+    bool depth_prepass = false;
+    // skips models and 3d texts hidden behind the depth of earlier frames.
+    // objects coming into view may appear a few frames late. it is off when
+    // the window's depth buffer is not 24 bit depth with 8 bit stencil.
+    bool occlusion_culling = false;
+};
+
+// objects and fragments skipped by renderers. counters accumulate until
+// reset_cull_stats(); they are written on the GL thread and may be read and
+// reset from any thread. fragments are counted as samples passing the depth
+// test and arrive a few frames late.
+struct cull_stats_t {
+    std::uint64_t models_drawn = 0;
+    std::uint64_t models_outside = 0; // of the view frustum
+    std::uint64_t models_occluded = 0;
+    std::uint64_t texts_occluded = 0;
+    std::uint64_t fragments_shaded = 0; // of opaque models
+    // drawn by the depth pre-pass but not shaded
+    std::uint64_t fragments_avoided = 0;
+};
+
+cull_stats_t cull_stats();
+void reset_cull_stats();
+
+// draws snapshots; it must be created, used and destroyed on the thread
+// owning the GL context. draw packets are recorded into one command list per
+// worker in parallel, sorted by key and replayed on the GL thread.
+struct renderer_t {
+    explicit renderer_t(render_options_t const & = {});
+    ~renderer_t();
+    renderer_t(renderer_t const &) = delete;
+    renderer_t &operator=(renderer_t const &) = delete;
+
+    void render(snapshot_t const &);
+    // rethrows an exception raised while encoding captured frames; the
+    // renderer stays usable
+    void rethrow_capture_error();
+
+private:
+    void record(snapshot_t const &);
+    void replay(snapshot_t const &);
+    // draws the first `end` packets, which are opaque
+    void replay_opaque(snapshot_t const &, std::size_t end);
+
+    // samples passed by one frame's pre-pass and shading pass
+    struct fragment_query_t {
+        id_t prepass_id = 0;
+        id_t shading_id = 0;
+        bool has_prepass = false;
+        bool pending = false;
+    };
+    // collects finished queries; returns nullptr when none is free
+    fragment_query_t *begin_fragment_query();
+    // evicts least recently used GPU objects of categories over their
+    // memory::budget()
+    void enforce_budgets(snapshot_t const &);
+
+    render_options_t m_options;
+    int m_framebuffer_width = 0;
+    int m_framebuffer_height = 0;
+
+    std::vector<command_list_t> m_lists;
+    std::vector<sorted_packet_t> m_order;
+    std::vector<sorted_packet_t> m_scratch;
+    // scratch data of the frame being rendered, reset by render()
+    detail::frame_arena_t m_arena;
+    detail::light_clusters_t m_clusters;
+    std::unique_ptr<detail::hi_z_t> m_hi_z; // with occlusion culling
+    std::array<fragment_query_t, 3> m_queries;
+    std::size_t m_next_query = 0;
+    // created on the first capture
+    std::unique_ptr<detail::frame_capture_t> m_capture;
+};
+
+namespace detail {
+
+// sets the swap interval of the current context
+void set_vsync(vsync_t);
+
+// owns the GL context of a window on a dedicated thread and renders the
+// latest published snapshot. snapshots are triple-buffered: the main thread
+// fills back() while the render thread draws another one, and a snapshot
+// published before the render thread picked up the previous one replaces it;
+// captures requested with the replaced one move to the new one.
+struct render_thread_t {
+    explicit render_thread_t(GLFWwindow *, vsync_t, render_options_t const &);
+    ~render_thread_t();
+
+    snapshot_t &back() { return m_snapshots[m_back]; }
+    void publish();
+
+    // rethrows an exception raised on the render thread
+    void rethrow_if_failed();
+    // rethrows an exception raised while encoding captured frames; the
+    // render thread keeps running
+    void rethrow_capture_error();
+
+private:
+    void run(std::promise<void> &);
+
+    GLFWwindow *m_window;
+    vsync_t m_vsync;
+    render_options_t m_options;
+    std::array<snapshot_t, 3> m_snapshots;
+    std::size_t m_back = 0;
+    std::size_t m_ready = 1;
+    std::size_t m_front = 2;
+    bool m_has_ready = false;
+    bool m_stop = false;
+    std::mutex m_mutex;
+    std::condition_variable m_condition;
+    std::exception_ptr m_error;
+    std::exception_ptr m_capture_error;
+    std::thread m_thread;
+};
+
+} // namespace detail
+
+} // namespace protowork
+
+#endif
@@ -0,0 +1,77 @@
+#ifndef PROTOWORK_REPLAY_HPP
+#define PROTOWORK_REPLAY_HPP
+
+#include <cstdint>
+#include <fstream>
+#include <string>
+#include <vector>
+
+#include <protowork/input.hpp>
+
+// input logs make benchmark sessions reproducible: input of every frame is
+// recorded once and replayed with a fixed timestep, so each run sees the
+// same camera path and interactions regardless of its frame rate.
+//
+// the log is little endian:
+//   magic "PWINPUT\0", u32 version, f64 initial mouse x, f64 initial mouse y
+//   per frame: f64 time, u32 event count, events
+//   per event: u8 kind, u8 action, u16 reserved, i32 code, i32 mods,
+//              f64 x, f64 y, f64 time
+namespace protowork {
+
+struct input_recorder_t {
+    // throws std::runtime_error when the file cannot be created
+    explicit input_recorder_t(std::string const &path,
+                              input_t const &initial);
+
+    // appends the frame's events; call once per frame after they were
+    // applied
+    void record(input_t const &);
+
+private:
+    std::ofstream m_out;
+    std::vector<char> m_buffer;
+};
+
+struct input_player_t {
+    // restores the initial mouse position into the input. throws
+    // std::runtime_error when the file is not an input log.
+    input_player_t(std::string const &path, input_t &, double step);
+
+    // replaces the input by the next recorded frame. frame time advances
+    // by exactly `step` per frame and event times keep their offset within
+    // the frame. returns false once the log is exhausted; throws
+    // std::runtime_error when a frame is corrupt.
+    bool next(input_t &);
+
+    std::size_t frame() const { return m_frame; }
+
+private:
+    std::ifstream m_in;
+    std::vector<char> m_buffer;
+    double m_step;
+    std::size_t m_frame = 0;
+};
+
+// durations of frames, e.g. to compare builds over a replayed session. every
+// frame is kept, so record only for sessions of limited length.
+struct frame_stats_t {
+    void add(double seconds) { m_frame_times.push_back(seconds); }
+    void clear() { m_frame_times.clear(); }
+
+    std::vector<double> const &frame_times() const { return m_frame_times; }
+    double mean() const;
+    // p in [0, 1]; 0 without frames
+    double percentile(double p) const;
+
+    // one "frame,seconds" row per frame; throws std::runtime_error on I/O
+    // failure
+    void write_csv(std::string const &path) const;
+
+private:
+    std::vector<double> m_frame_times;
+};
+
+} // namespace protowork
+
+#endif
@@ -0,0 +1,95 @@
+#ifndef PROTOWORK_STORE_HPP
+#define PROTOWORK_STORE_HPP
+
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+namespace protowork {
+
+// stable reference to an element of a store. a handle of a removed element
+// never becomes valid again, even when its slot is reused.
+struct handle_t {
+    std::uint32_t index = UINT32_MAX;
+    std::uint32_t generation = 0;
+
+    bool operator==(handle_t const &) const = default;
+};
+
+namespace detail {
+
+// maps handles to indices of densely packed arrays. owners remove elements
+// by moving the last element into the hole and calling relocate() for it.
+struct slot_table_t {
+    handle_t insert(std::uint32_t dense);
+    // returns the dense index of the removed element
+    std::uint32_t erase(handle_t);
+    void relocate(handle_t, std::uint32_t dense);
+    void clear();
+
+    bool contains(handle_t) const;
+    std::uint32_t dense(handle_t) const;
+
+private:
+    struct slot_t {
+        std::uint32_t dense;
+        std::uint32_t generation;
+    };
+    std::vector<slot_t> m_slots;
+    std::vector<std::uint32_t> m_free;
+};
+
+} // namespace detail
+
+// densely packed shared elements addressed by handles with O(1) insertion
+// and removal. removal does not preserve order. it keeps the vector-like
+// interface of std::vector<std::shared_ptr<T>> used by older code.
+template <typename T> struct store_t {
+    using value_type = std::shared_ptr<T>;
+    using const_iterator = typename std::vector<value_type>::const_iterator;
+
+    handle_t push_back(value_type value) {
+        auto handle = m_slots.insert(m_items.size());
+        m_items.push_back(std::move(value));
+        m_handles.push_back(handle);
+        return handle;
+    }
+
+    void erase(handle_t handle) {
+        auto dense = m_slots.erase(handle);
+        if (dense + 1 != m_items.size()) {
+            m_items[dense] = std::move(m_items.back());
+            m_handles[dense] = m_handles.back();
+            m_slots.relocate(m_handles[dense], dense);
+        }
+        m_items.pop_back();
+        m_handles.pop_back();
+    }
+
+    void clear() {
+        m_slots.clear();
+        m_items.clear();
+        m_handles.clear();
+    }
+
+    bool contains(handle_t handle) const { return m_slots.contains(handle); }
+    value_type const &get(handle_t handle) const {
+        return m_items[m_slots.dense(handle)];
+    }
+    handle_t handle(std::size_t i) const { return m_handles[i]; }
+
+    std::size_t size() const { return m_items.size(); }
+    bool empty() const { return m_items.empty(); }
+    value_type const &operator[](std::size_t i) const { return m_items[i]; }
+    const_iterator begin() const { return m_items.begin(); }
+    const_iterator end() const { return m_items.end(); }
+
+private:
+    detail::slot_table_t m_slots;
+    std::vector<value_type> m_items;
+    std::vector<handle_t> m_handles;
+};
+
+} // namespace protowork
+
+#endif
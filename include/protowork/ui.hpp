@@ -3,12 +3,13 @@
 
 #include <vector>
 #include <memory>
+#include <protowork/store.hpp>
 #include <protowork/ui/text2d.hpp>
 
 namespace protowork {
 
 struct ui_t {
-    std::vector<std::shared_ptr<ui::text2d_t>> texts_2d;
+    store_t<ui::text2d_t> texts_2d;
 };
 
 } // namespace protowork
@@ -1,6 +1,9 @@
 #ifndef PROTOWORK_UTIL_HPP
 #define PROTOWORK_UTIL_HPP
 
+#include <initializer_list>
+#include <limits>
+
 #include <GL/glew.h>
 #include <glm/glm.hpp>
 
@@ -15,6 +18,29 @@ using pos_t = glm::vec3;
 using index_t = GLushort;
 using id_t = GLuint;
 
+// axis aligned bounding box; a default constructed box is empty
+struct aabb_t {
+    pos_t min = pos_t(std::numeric_limits<float>::max());
+    pos_t max = pos_t(-std::numeric_limits<float>::max());
+
+    bool empty() const { return min.x > max.x; }
+    void extend(pos_t const &p) {
+        min = glm::min(min, p);
+        max = glm::max(max, p);
+    }
+};
+
+// bounds of the box transformed by the matrix
+aabb_t transform_bounds(aabb_t const &, matrix_t const &);
+
+namespace detail {
+// GL objects may be released on a thread without the GL context; they are
+// queued and deleted by flush_released_objects() on the GL thread.
+void release_buffers(std::initializer_list<id_t>);
+void release_vertex_arrays(std::initializer_list<id_t>);
+void flush_released_objects();
+} // namespace detail
+
 } // namespace protowork
 
 #endif
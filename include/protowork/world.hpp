@@ -4,15 +4,20 @@
 #include <vector>
 #include <memory>
 
+#include <protowork/store.hpp>
 #include <protowork/world/camera.hpp>
+#include <protowork/world/light.hpp>
 #include <protowork/world/model.hpp>
+#include <protowork/world/model_list.hpp>
 #include <protowork/world/text3d.hpp>
 
 namespace protowork {
 
 struct world_t {
-    std::vector<std::shared_ptr<world::model_t>> models;
-    std::vector<std::shared_ptr<world::text3d_t>> texts_3d;
+    world::model_list_t models;
+    store_t<world::text3d_t> texts_3d;
+    store_t<world::point_light_t> lights;
+    world::directional_light_t directional_light;
     world::camera_t camera;
 };
 
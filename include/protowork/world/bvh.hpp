@@ -0,0 +1,81 @@
+#ifndef PROTOWORK_WORLD_BVH_HPP
+#define PROTOWORK_WORLD_BVH_HPP
+
+#include <algorithm>
+#include <cstdint>
+#include <vector>
+#include <protowork/util.hpp>
+
+namespace protowork::world {
+
+struct ray_t {
+    pos_t origin;
+    glm::vec3 direction;
+};
+
+// returns the distance along the ray at which it enters the box, or a
+// negative value when it misses the box or enters it beyond t_max
+float intersect(ray_t const &, glm::vec3 const &inv_direction, aabb_t const &,
+                float t_max);
+
+// bounding volume hierarchy over boxes of arbitrary primitives, built with
+// a binned surface area heuristic and stored as a flat depth-first array
+struct bvh_t {
+    struct node_t {
+        aabb_t bounds;
+        // leaf: primitives [first, first + count) of `primitives`
+        // inner: left child follows the node, right child is at `first`
+        std::uint32_t first;
+        std::uint32_t count;
+    };
+
+    void build(std::vector<aabb_t> const &boxes);
+    bool empty() const { return nodes.empty(); }
+
+    // calls hit(primitive, t_max) for primitives whose box the ray enters
+    // before t_max, nearest boxes first. hit returns the distance of its
+    // own intersection, which shortens t_max when it is smaller.
+    template <typename F>
+    void traverse(ray_t const &ray, float t_max, F &&hit) const {
+        if (nodes.empty())
+            return;
+        auto inv_direction = 1.f / ray.direction;
+        std::uint32_t stack[64];
+        std::size_t top = 0;
+        if (intersect(ray, inv_direction, nodes[0].bounds, t_max) < 0.f)
+            return;
+        stack[top++] = 0;
+        while (top != 0) {
+            auto const &node = nodes[stack[--top]];
+            if (node.count != 0) {
+                for (auto i = node.first; i < node.first + node.count; i++)
+                    t_max = std::min(t_max, hit(primitives[i], t_max));
+                continue;
+            }
+            auto left = static_cast<std::uint32_t>(&node - nodes.data()) + 1;
+            auto right = node.first;
+            auto t_left = intersect(ray, inv_direction, nodes[left].bounds,
+                                    t_max);
+            auto t_right = intersect(ray, inv_direction, nodes[right].bounds,
+                                     t_max);
+            // the nearer child is pushed last so it is visited first
+            if (t_left >= 0.f && t_right >= 0.f) {
+                if (t_left < t_right)
+                    std::swap(left, right);
+                stack[top++] = left;
+                stack[top++] = right;
+            } else if (t_left >= 0.f) {
+                stack[top++] = left;
+            } else if (t_right >= 0.f) {
+                stack[top++] = right;
+            }
+        }
+    }
+
+    std::vector<node_t> nodes;
+    std::vector<std::uint32_t> primitives;
+};
+
+} // namespace protowork::world
+
+#endif
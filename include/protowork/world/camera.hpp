@@ -10,15 +10,35 @@ namespace protowork::world {
 
 struct camera_t {
     explicit camera_t();
-    void update(protowork::input_t const &);
+    // advances the camera by one step of dt seconds. it consumes every
+    // event of the input: left drag orbits, middle drag pans and scroll
+    // zooms. held arrow keys orbit at a fixed angular speed.
+    void update(protowork::input_t const &, double dt);
     matrix_t projection() const;
-    matrix_t view() const;
+    matrix_t view() const { return view(1.0); }
+    // view between the state before and after the last update(); alpha is
+    // the fraction of the step elapsed
+    matrix_t view(double alpha) const;
 
 private:
+    void orbit(float yaw, float pitch);
+    void pan(float dx, float dy);
+
     matrix_t m_view;
     glm::quat m_orientation;
     float m_distance = 5.f;
     pos_t m_target_pos = pos_t{0, 0, 0};
+
+    // state before the last update(), for interpolation
+    glm::quat m_previous_orientation;
+    float m_previous_distance = 5.f;
+    pos_t m_previous_target_pos = pos_t{0, 0, 0};
+
+    // cursor position and buttons as of the last consumed event
+    bool m_has_mouse = false;
+    double m_mouse_x = 0.0;
+    double m_mouse_y = 0.0;
+    bool m_buttons[input_t::mouse_t::N_BUTTONS] = {};
 };
 
 }; // namespace protowork::world
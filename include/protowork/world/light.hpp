@@ -0,0 +1,25 @@
+#ifndef PROTOWORK_WORLD_LIGHT_HPP
+#define PROTOWORK_WORLD_LIGHT_HPP
+
+#include <protowork/util.hpp>
+
+namespace protowork::world {
+
+// light at a point in world space. its contribution fades out smoothly and
+// is zero beyond `radius`, which bounds the clusters it is binned into.
+struct point_light_t {
+    pos_t position = pos_t{0.f};
+    glm::vec3 color = glm::vec3{1.f};
+    float intensity = 1.f;
+    float radius = 10.f;
+};
+
+// light from infinitely far away, shading every fragment
+struct directional_light_t {
+    glm::vec3 direction = glm::vec3{-1.f, -1.f, -1.f}; // world space
+    glm::vec3 color = glm::vec3{1.f};
+};
+
+} // namespace protowork::world
+
+#endif
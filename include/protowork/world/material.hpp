@@ -0,0 +1,74 @@
+#ifndef PROTOWORK_WORLD_MATERIAL_HPP
+#define PROTOWORK_WORLD_MATERIAL_HPP
+
+#include <array>
+#include <cstdint>
+
+#include <protowork/util.hpp>
+
+namespace protowork::detail {
+constexpr std::size_t N_FEATURES = 3;
+constexpr std::size_t N_PERMUTATIONS = std::size_t{1} << N_FEATURES;
+// bits of known features
+constexpr std::uint32_t FEATURE_MASK = N_PERMUTATIONS - 1;
+
+// GLSL lines enabling feature 1 << i
+constexpr std::array<char const *, N_FEATURES> FEATURE_DEFINES = {
+    "#define HAS_TEXTURE\n",
+    "#define HAS_VERTEX_COLOR\n",
+    "#define UNLIT\n",
+};
+} // namespace protowork::detail
+
+namespace protowork::world {
+
+// optional features of the model program. every combination is a separate
+// program compiled from the same source with a #define per feature, so a
+// fragment never branches on a feature at runtime.
+enum feature_t : std::uint32_t {
+    TEXTURE = 1u << 0,      // samples `texture` at model coords
+    VERTEX_COLOR = 1u << 1, // multiplies the color by model colors
+    UNLIT = 1u << 2,        // color as is, without lights
+};
+
+// combination of features known at compile time, e.g.
+// features_v<TEXTURE, UNLIT>
+template <feature_t... Features>
+constexpr std::uint32_t features_v = (0u | ... | Features);
+
+// how models are shaded. materials are copied into snapshots, so changing
+// one takes effect from the next frame.
+struct material_t {
+    // feature_t flags; other bits are ignored
+    std::uint32_t features = 0;
+    glm::vec3 color = glm::vec3{1.f, 0.2f, 0.2f};
+    glm::vec3 ambient = glm::vec3{0.2f, 0.1f, 0.1f};
+    // GL texture name used with TEXTURE. the owner keeps it alive while
+    // the material may be rendered.
+    id_t texture = 0;
+
+    bool operator==(material_t const &) const = default;
+
+    // state bits of the sort key: draws are grouped by program first and by
+    // texture within a program
+    constexpr std::uint32_t sort_state() const {
+        return (features & detail::FEATURE_MASK) << 24 |
+               (texture & 0x00ffffffu);
+    }
+};
+
+template <feature_t... Features>
+material_t make_material(glm::vec3 color = material_t{}.color,
+                         id_t texture = 0) {
+    constexpr auto features = features_v<Features...>;
+    static_assert(features < detail::N_PERMUTATIONS, "unknown feature");
+    material_t material;
+    material.features = features;
+    material.color = color;
+    material.texture = texture;
+    return material;
+}
+
+} // namespace protowork::world
+
+#endif
@@ -0,0 +1,132 @@
+#ifndef PROTOWORK_WORLD_MESH_FILE_HPP
+#define PROTOWORK_WORLD_MESH_FILE_HPP
+
+#include <atomic>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include <protowork/world/model.hpp>
+
+// protowork binary mesh (.pwm). the file is a header, a chunk table and the
+// chunk data, all little endian:
+//
+//   header_t
+//   chunk_t[header.chunk_count]
+//   per chunk, each array aligned to 16 bytes:
+//     positions: float[3] per vertex, or uint16[4] when QUANTIZED
+//     normals:   float[3] per vertex, or int16[4] when QUANTIZED
+//     indices:   index_t per index
+//
+// every chunk holds at most 65536 vertices so that it is drawn with
+// index_t indices. quantized positions are normalized to the chunk bounds
+// and normals to [-1, 1]; the GPU dequantizes both as normalized
+// attributes, so they are uploaded without conversion.
+namespace protowork::world::mesh_file {
+
+constexpr char MAGIC[8] = {'P', 'W', 'M', 'E', 'S', 'H', '\0', '\0'};
+constexpr std::uint32_t VERSION = 1;
+constexpr std::size_t MAX_CHUNK_VERTICES = 65536;
+
+enum flags_t : std::uint32_t { QUANTIZED = 1 };
+
+struct header_t {
+    char magic[8];
+    std::uint32_t version;
+    std::uint32_t flags;
+    std::uint32_t chunk_count;
+    std::uint32_t reserved;
+    float min[3];
+    float max[3];
+};
+
+struct chunk_t {
+    std::uint64_t offset;
+    std::uint32_t vertex_count;
+    std::uint32_t index_count;
+    float min[3];
+    float max[3];
+};
+
+struct options_t {
+    bool quantize = false;
+};
+
+// splits the mesh into chunks, deduplicates vertices, orders each chunk's
+// vertices by first use and writes it. throws std::runtime_error on I/O
+// failure.
+void write(std::string const &path, std::vector<pos_t> const &vertices,
+           std::vector<glm::vec3> const &normals,
+           std::vector<std::uint32_t> const &indices, options_t = {});
+
+// mesh as read from a source file, before it is split into chunks
+struct source_t {
+    std::vector<pos_t> vertices;
+    std::vector<glm::vec3> normals; // empty when the file has none
+    std::vector<std::uint32_t> indices;
+};
+
+// reads a Wavefront OBJ or a PLY (ascii or binary little endian) file,
+// chosen by extension. throws std::runtime_error on failure.
+source_t read_source(std::string const &path);
+
+// area weighted vertex normals
+std::vector<glm::vec3> compute_normals(std::vector<pos_t> const &vertices,
+                                       std::vector<std::uint32_t> const &);
+
+// converts a Wavefront OBJ or a PLY (ascii or binary little endian) file,
+// chosen by extension. missing normals are computed from the faces.
+void convert(std::string const &src, std::string const &dst, options_t = {});
+
+} // namespace protowork::world::mesh_file
+
+namespace protowork::world {
+
+// model drawn from a memory-mapped .pwm file. chunk data is uploaded to GPU
+// buffers straight from the mapping, at most `upload_budget` bytes per
+// frame, so files larger than memory stream in over several frames; pages
+// of uploaded chunks are released again. chunks appear as they arrive.
+// vertices/normals/indices stay empty, so the model is not pickable by
+// triangle.
+struct mapped_model_t : model_t {
+    explicit mapped_model_t(std::string const &path,
+                            std::size_t upload_budget = 64 << 20);
+    ~mapped_model_t() override;
+    mapped_model_t(mapped_model_t const &) = delete;
+    mapped_model_t &operator=(mapped_model_t const &) = delete;
+
+    void draw(matrix_t const &, geometry_t const *,
+              std::uint64_t) const override;
+    aabb_t compute_bounds() const override;
+    std::size_t gpu_bytes() const override { return m_gpu_bytes; }
+    // chunks are uploaded again within the upload budget of later draws
+    void evict() const override;
+
+    bool is_resident() const { return m_n_uploaded == m_chunks.size(); }
+
+private:
+    struct gpu_chunk_t {
+        id_t vertex_array_id = 0;
+        id_t vertex_buffer_id = 0;
+        id_t normal_buffer_id = 0;
+        id_t index_buffer_id = 0;
+        std::uint32_t index_count = 0; // 0 when the indices are invalid
+    };
+
+    void upload(std::size_t chunk) const;
+
+    void *m_data = nullptr;
+    std::size_t m_size = 0;
+    mesh_file::header_t const *m_header = nullptr;
+    mesh_file::chunk_t const *m_chunks_table = nullptr;
+    std::size_t m_upload_budget;
+
+    mutable std::vector<gpu_chunk_t> m_chunks;
+    mutable std::size_t m_gpu_bytes = 0;
+    // written on the GL thread, read by is_resident() on any thread
+    mutable std::atomic<std::size_t> m_n_uploaded = 0;
+};
+
+} // namespace protowork::world
+
+#endif
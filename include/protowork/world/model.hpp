@@ -1,31 +1,137 @@
 #ifndef PROTOWORK_WORLD_MODEL_HPP
 #define PROTOWORK_WORLD_MODEL_HPP
 
+#include <array>
+#include <cstdint>
+#include <memory>
 #include <vector>
+#include <protowork/lighting.hpp>
+#include <protowork/world/bvh.hpp>
 #include <protowork/world/camera.hpp>
+#include <protowork/world/material.hpp>
 
 namespace protowork::world {
 
+// immutable copy of model geometry handed over to the render thread
+struct geometry_t {
+    std::vector<pos_t> vertices;
+    std::vector<glm::vec3> normals;
+    std::vector<glm::vec2> coords;
+    std::vector<glm::vec3> colors;
+    std::vector<index_t> indices;
+};
+
 struct model_t {
     explicit model_t();
     virtual ~model_t();
 
+    // GL objects are created lazily, so draw() must be called on the thread
+    // owning the GL context. geometry is uploaded only when revision() changed.
     void draw() const;
+    virtual void draw(matrix_t const &, geometry_t const *,
+                      std::uint64_t) const;
+
+    // replaces the geometry and bumps the revision
+    void set_geometry(geometry_t);
+    // bumps the revision. until it or set_geometry() is first called,
+    // revision() hashes the whole geometry to notice edits made in place;
+    // afterwards only changes of the array sizes are noticed, and
+    // invalidate() must follow every other edit.
+    void invalidate() {
+        m_revision++;
+        m_explicit_revisions = true;
+    }
+    // changes whenever the geometry may have; it must not be called while
+    // another thread modifies the model
+    std::uint64_t revision() const;
+
+    // uploads vertices/normals/indices to GPU buffers unless the current
+    // revision already is. it binds nothing, so it may run on any context
+    // sharing objects with the renderer's, e.g. the loader's.
+    void upload() const;
+
+    // returns geometry copy for the current revision (main thread only)
+    std::shared_ptr<geometry_t const> publish_geometry() const;
+
+    // bounds of vertices in model space
+    virtual aabb_t compute_bounds() const;
+
+    // bytes of the GPU copy of the geometry
+    virtual std::size_t gpu_bytes() const { return m_gpu_bytes; }
+    // frees the GPU copy of the geometry, which the next draw uploads
+    // again. it must be called on the thread owning the GL context.
+    virtual void evict() const;
+    // before_drawing() call of the last frame that drew the model
+    std::uint64_t last_drawn() const { return m_last_drawn; }
+    // frame of the latest before_drawing() call
+    static std::uint64_t current_frame();
+
+    // BVH over triangles in model space, rebuilt on first use after the
+    // revision changed (main thread only)
+    bvh_t const &triangle_bvh() const;
 
     static void initialize(); // initialize shader for model_t
     static void finalize();   // finalize for model_t
-    static void before_drawing(camera_t const &);
+    static void before_drawing(matrix_t const &projection,
+                               matrix_t const &view,
+                               detail::cluster_params_t const &);
+    // binds the program of the material's features, compiling it on first
+    // use, and sets the material's uniforms
+    static void use_material(material_t const &);
+    // binds a program writing only depth, for a depth pre-pass. its
+    // positions match those of every material exactly.
+    static void use_depth_only();
 
     std::vector<pos_t> vertices;
     std::vector<glm::vec3> normals;
+    // per vertex, read by materials with TEXTURE and VERTEX_COLOR; may be
+    // empty otherwise
+    std::vector<glm::vec2> coords;
+    std::vector<glm::vec3> colors;
     std::vector<index_t> indices;
     matrix_t model_matrix = matrix_t(1.f);
+    material_t material;
+
+protected:
+    // sets u_ModelMatrix and the normal matrix of the model program, which
+    // is bound while models are drawn. normals are transformed by the
+    // inverse transpose of `normal_basis`.
+    static void set_model_matrix(matrix_t const &);
+    static void set_model_matrix(matrix_t const &,
+                                 matrix_t const &normal_basis);
+    // records that the model is drawn in the current frame
+    void mark_drawn() const;
 
 private:
-    id_t m_vertex_array_id;
-    id_t m_vertex_buffer_id;
-    id_t m_normal_buffer_id;
-    id_t m_index_buffer_id;
+    void upload(geometry_t const *, std::uint64_t revision) const;
+
+    mutable std::uint64_t m_revision = 0;
+    // sizes of the geometry arrays as of m_revision
+    mutable std::array<std::size_t, 5> m_sizes = {};
+    // hash of the geometry as of m_revision, unless revisions are explicit
+    mutable std::uint64_t m_hash = 0;
+    bool m_explicit_revisions = false;
+
+    mutable std::shared_ptr<geometry_t const> m_published;
+    mutable std::uint64_t m_published_revision = UINT64_MAX;
+
+    mutable bvh_t m_bvh;
+    mutable std::uint64_t m_bvh_revision = UINT64_MAX;
+
+    mutable std::uint64_t m_uploaded_revision = UINT64_MAX;
+    mutable std::size_t m_index_count = 0;
+    mutable std::size_t m_gpu_bytes = 0;
+    mutable std::uint64_t m_last_drawn = 0;
+    mutable id_t m_vertex_array_id = 0;
+    mutable id_t m_vertex_buffer_id = 0;
+    mutable id_t m_normal_buffer_id = 0;
+    mutable id_t m_coord_buffer_id = 0;
+    mutable id_t m_color_buffer_id = 0;
+    mutable id_t m_index_buffer_id = 0;
+    // optional attributes with data, as recorded in the vertex array
+    mutable bool m_has_coords = false;
+    mutable bool m_has_colors = false;
+    mutable bool m_vertex_array_stale = true;
 };
 
 } // namespace protowork::world
@@ -0,0 +1,117 @@
+#ifndef PROTOWORK_WORLD_MODEL_LIST_HPP
+#define PROTOWORK_WORLD_MODEL_LIST_HPP
+
+#include <cstdint>
+#include <memory>
+#include <tuple>
+#include <vector>
+
+#include <protowork/store.hpp>
+#include <protowork/world/model.hpp>
+
+namespace protowork::world {
+
+// models of a world kept in structure-of-arrays layout. transforms, bounds
+// and render data of element i are stored in separate contiguous arrays, so
+// per-frame passes touch only the data they need. elements are addressed by
+// handles; insertion and removal are O(1), removal does not preserve order.
+//
+// elements may be parented to other elements. the arrays are kept sorted by
+// depth in the hierarchy, so world transforms are propagated in one forward
+// pass in which every parent precedes its children, and only elements whose
+// local transform or ancestor changed are recomputed.
+struct model_list_t {
+    using const_iterator =
+        std::vector<std::shared_ptr<model_t>>::const_iterator;
+
+    // the element follows model->model_matrix, like models pushed into the
+    // former std::vector<std::shared_ptr<model_t>>
+    handle_t push_back(std::shared_ptr<model_t>);
+    // the element owns its local transform; model->model_matrix is ignored
+    handle_t insert(std::shared_ptr<model_t>, matrix_t const &transform);
+    // children of a removed element become roots
+    void erase(handle_t);
+    void clear();
+
+    bool contains(handle_t handle) const { return m_slots.contains(handle); }
+    std::shared_ptr<model_t> const &get(handle_t handle) const {
+        return m_owners[m_slots.dense(handle)];
+    }
+    handle_t handle(std::size_t i) const { return m_handles[i]; }
+
+    // world transform as of the last sync()
+    matrix_t const &transform(handle_t handle) const {
+        return m_transforms[m_slots.dense(handle)];
+    }
+    matrix_t const &local_transform(handle_t handle) const {
+        return m_local_transforms[m_slots.dense(handle)];
+    }
+    // sets the transform relative to the parent and detaches the element
+    // from model->model_matrix
+    void set_transform(handle_t, matrix_t const &);
+
+    // throws std::invalid_argument when it would create a cycle
+    void set_parent(handle_t child, handle_t parent);
+    void clear_parent(handle_t child);
+
+    // copies model_matrix of following elements, recomputes bounds of
+    // models whose geometry revision changed and propagates world
+    // transforms. it reads every model, so call it once per frame before
+    // the dense arrays are used.
+    void sync();
+
+    // changes whenever elements, world transforms or bounds change
+    std::uint64_t version() const { return m_version; }
+
+    std::size_t size() const { return m_owners.size(); }
+    bool empty() const { return m_owners.empty(); }
+    std::shared_ptr<model_t> const &operator[](std::size_t i) const {
+        return m_owners[i];
+    }
+    const_iterator begin() const { return m_owners.begin(); }
+    const_iterator end() const { return m_owners.end(); }
+
+    // dense arrays indexed like operator[], valid after sync(); bounds are
+    // in model space
+    std::vector<matrix_t> const &transforms() const { return m_transforms; }
+    std::vector<aabb_t> const &bounds() const { return m_bounds; }
+    std::vector<std::uint64_t> const &revisions() const { return m_revisions; }
+    std::vector<model_t *> const &render_data() const { return m_models; }
+
+private:
+    static constexpr std::uint32_t NO_PARENT = UINT32_MAX;
+
+    handle_t emplace(std::shared_ptr<model_t>, matrix_t const &, bool);
+    void sort_by_depth();
+    void propagate_transforms(std::size_t begin, std::size_t end);
+
+    auto arrays() {
+        return std::tie(m_handles, m_local_transforms, m_transforms,
+                        m_parents, m_parent_indices, m_dirty, m_bounds,
+                        m_revisions, m_models, m_follows_model, m_owners);
+    }
+
+    detail::slot_table_t m_slots;
+    std::vector<handle_t> m_handles;
+    std::vector<matrix_t> m_local_transforms;
+    std::vector<matrix_t> m_transforms;
+    std::vector<handle_t> m_parents;
+    // dense index of the parent, valid while the order is not stale
+    std::vector<std::uint32_t> m_parent_indices;
+    std::vector<std::uint8_t> m_dirty;
+    std::vector<aabb_t> m_bounds;
+    std::vector<std::uint64_t> m_revisions;
+    std::vector<model_t *> m_models;
+    std::vector<std::uint8_t> m_follows_model;
+    std::vector<std::shared_ptr<model_t>> m_owners;
+
+    // [m_depth_offsets[d], m_depth_offsets[d + 1]) holds elements of depth d
+    std::vector<std::size_t> m_depth_offsets;
+    std::size_t m_n_parented = 0;
+    std::uint64_t m_version = 0;
+    bool m_order_stale = false;
+};
+
+} // namespace protowork::world
+
+#endif
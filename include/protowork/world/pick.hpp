@@ -0,0 +1,52 @@
+#ifndef PROTOWORK_WORLD_PICK_HPP
+#define PROTOWORK_WORLD_PICK_HPP
+
+#include <cstdint>
+#include <optional>
+
+#include <protowork/world.hpp>
+#include <protowork/world/bvh.hpp>
+
+namespace protowork::world {
+
+struct pick_result_t {
+    enum class kind_t { MODEL, LABEL };
+
+    kind_t kind;
+    // element of world.models or world.texts_3d
+    handle_t handle;
+    // MODEL: the triangle made of indices [3 * triangle, 3 * triangle + 3)
+    std::uint32_t triangle = 0;
+    // MODEL: weights of the second and third vertex of the triangle
+    glm::vec2 barycentric = glm::vec2(0.f);
+    // from the camera, in world units
+    float distance;
+};
+
+// ray from the camera through a window position given like input_t::mouse
+ray_t make_ray(camera_t const &, double x, double y, int screen_width,
+               int screen_height);
+
+// picks with a scene level BVH over model bounds and the triangle BVH of
+// each model. the scene BVH is kept between calls and rebuilt only when the
+// models changed. main thread only; world.models.sync() must be up to date.
+struct picker_t {
+    // nearest model triangle hit by the ray
+    std::optional<pick_result_t> pick(world_t const &, ray_t const &);
+
+    // label or model under a window position. labels are drawn on top of
+    // models and win over them; labels whose font was not rendered yet are
+    // not pickable.
+    std::optional<pick_result_t> pick(world_t const &, double x, double y,
+                                      int screen_width, int screen_height);
+
+private:
+    model_list_t const *m_models = nullptr;
+    std::uint64_t m_version = UINT64_MAX;
+    std::vector<aabb_t> m_boxes;
+    bvh_t m_scene_bvh;
+};
+
+} // namespace protowork::world
+
+#endif
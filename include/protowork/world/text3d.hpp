@@ -4,14 +4,16 @@
 #include <string>
 #include <protowork/util.hpp>
 
-struct GLFWwindow;
-
 namespace protowork::world {
 
 struct text3d_t {
-    void append(GLFWwindow *window, glm::mat4 const &,
+    void append(int screen_width, int screen_height, glm::mat4 const &,
                 std::vector<glm::vec2> &vertices,
                 std::vector<glm::vec2> &uvs) const;
+    // pixel rectangle covered by the glyphs relative to the projected pos:
+    // left, bottom, right and top. empty until the font's atlas exists.
+    glm::vec4 extent() const;
+
     pos_t pos;
     int font_size;
     std::string text;
@@ -1,6 +1,9 @@
 #include <GL/glew.h>
 #include <GLFW/glfw3.h>
+#include <algorithm>
+#include <chrono>
 #include <stdexcept>
+#include <thread>
 
 #include <protowork.hpp>
 #include <protowork/world.hpp>
@@ -9,11 +12,48 @@
 
 using namespace protowork;
 
-app_t::app_t(config_t const &config) {
+static void push_event(GLFWwindow *window, event_t const &event) {
+    auto *queue =
+        static_cast<detail::event_queue_t *>(glfwGetWindowUserPointer(window));
+    queue->push(event);
+}
+
+static void cursor_pos_callback(GLFWwindow *window, double x, double y) {
+    push_event(window, {event_t::kind_t::MOUSE_MOVE, event_t::action_t{}, 0,
+                        0, x, y, glfwGetTime()});
+}
+
+static void mouse_button_callback(GLFWwindow *window, int button, int action,
+                                  int mods) {
+    push_event(window, {event_t::kind_t::MOUSE_BUTTON,
+                        static_cast<event_t::action_t>(action), button, mods,
+                        0.0, 0.0, glfwGetTime()});
+}
+
+static void scroll_callback(GLFWwindow *window, double x, double y) {
+    push_event(window, {event_t::kind_t::SCROLL, event_t::action_t{}, 0, 0,
+                        x, y, glfwGetTime()});
+}
+
+static void key_callback(GLFWwindow *window, int key, int, int action,
+                         int mods) {
+    push_event(window, {event_t::kind_t::KEY,
+                        static_cast<event_t::action_t>(action), key, mods, 0.0,
+                        0.0, glfwGetTime()});
+}
+
+app_t::app_t(config_t const &config)
+    : m_collect_frame_stats{config.frame_stats ||
+                            config.replay_input != nullptr},
+      m_timestep{config.timestep}, m_max_fps{config.max_fps},
+      m_on_demand{config.on_demand} {
     if (!glfwInit())
         throw std::runtime_error{"Failed to initialize GLFW"};
 
     glfwWindowHint(GLFW_SAMPLES, 4);
+    // the format occlusion culling resolves depth into
+    glfwWindowHint(GLFW_DEPTH_BITS, 24);
+    glfwWindowHint(GLFW_STENCIL_BITS, 8);
     glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 4);
     glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
 
@@ -35,87 +75,272 @@ app_t::app_t(config_t const &config) {
     // Set the mouse at the center of the screen
     glfwPollEvents();
     glfwSetCursorPos(m_window, config.width / 2, config.height / 2);
+    glfwGetCursorPos(m_window, &m_input.mouse.x, &m_input.mouse.y);
 
-    glClearColor(0.0f, 0.0f, 0.4f, 0.0f);
+    // events are queued as they arrive and consumed by update()
+    glfwSetWindowUserPointer(m_window, &m_events);
+    glfwSetCursorPosCallback(m_window, cursor_pos_callback);
+    glfwSetMouseButtonCallback(m_window, mouse_button_callback);
+    glfwSetScrollCallback(m_window, scroll_callback);
+    glfwSetKeyCallback(m_window, key_callback);
 
-    glEnable(GL_DEPTH_TEST);
-    glDepthFunc(GL_LESS);
-    glEnable(GL_CULL_FACE);
-    glPointSize(10.0f);
+    try {
+        if (config.replay_input)
+            m_player = std::make_unique<input_player_t>(
+                config.replay_input, m_input, config.timestep);
+        if (config.record_input)
+            m_recorder = std::make_unique<input_recorder_t>(
+                config.record_input, m_input);
 
-    world::model_t::initialize();
-    font::initialize();
+        // the loader's context must be created while the window's context
+        // is not current on another thread
+        m_loader = std::make_unique<loader_t>(m_window);
+        render_options_t options;
+        options.depth_prepass = config.depth_prepass;
+        options.occlusion_culling = config.occlusion_culling;
+        if (config.threaded_rendering) {
+            m_render_thread = std::make_unique<detail::render_thread_t>(
+                m_window, config.vsync, options);
+        } else {
+            detail::set_vsync(config.vsync);
+            m_renderer = std::make_unique<renderer_t>(options);
+        }
+    } catch (...) {
+        m_loader.reset();
+        glfwTerminate();
+        throw;
+    }
 }
 
 app_t::~app_t() {
-    font::finalize();
-    world::model_t::finalize();
+    m_loader.reset();
+    m_render_thread.reset();
+    m_renderer.reset();
     glfwTerminate();
 }
 
 bool app_t::should_close() const {
-    if (glfwWindowShouldClose(m_window) != 0)
+    if (glfwWindowShouldClose(m_window) != 0 || m_replay_finished)
         return true;
     return false;
 }
 
-void update_input(GLFWwindow *window, input_t &input) {
-    glfwGetCursorPos(window, &input.mouse.x, &input.mouse.y);
-
-    // as innter representation:
-    //   button_t::LEFT == GLFW_MOUSE_BUTTON_LEFT
-    //   button_t::RIGHT == GLFW_MOUSE_BUTTON_RIGHT
-    //   button_t::MIDDLE == GLFW_MOUSE_BUTTON_MIDDLE
-    using button_t = input_t::mouse_t::button_t;
-    using button_state_t = input_t::mouse_t::button_state_t;
-    auto &mouse = input.mouse;
-    for (int button = button_t::LEFT; button < button_t::N_BUTTONS; button++) {
-        auto prev = mouse.buttons[button];
-        bool is_current_pressed =
-            glfwGetMouseButton(window, button) == GLFW_PRESS;
-        if (!is_current_pressed)
-            mouse.buttons[button] = button_state_t::RELEASED;
-        else if (prev == button_state_t::RELEASED)
-            mouse.buttons[button] = button_state_t::PUSHED;
-        else
-            mouse.buttons[button] = button_state_t::PRESSED;
-    }
+void app_t::close() { glfwSetWindowShouldClose(m_window, GLFW_TRUE); }
+
+static void update_input(detail::event_queue_t &queue, input_t &input) {
+    input.begin_frame();
+    event_t event;
+    while (queue.pop(event))
+        input.apply(event);
 }
 
 void app_t::update() {
-    update_input(m_window, m_input);
-    world.camera.update(m_input);
+    if (m_player) {
+        // live events are drained so that the queue does not fill up
+        event_t event;
+        while (m_events.pop(event)) {
+        }
+        if (!m_player->next(m_input))
+            m_replay_finished = true;
+    } else {
+        update_input(m_events, m_input);
+        m_input.time = glfwGetTime();
+    }
+    if (m_recorder)
+        m_recorder->record(m_input);
+    if (!m_input.events.empty())
+        m_redraw = true;
+    world.camera.update(m_input, m_timestep);
+}
+
+std::optional<world::pick_result_t> app_t::pick() {
+    int width, height;
+    glfwGetWindowSize(m_window, &width, &height);
+    world.models.sync();
+    return m_picker.pick(world, m_input.mouse.x, m_input.mouse.y, width,
+                         height);
 }
 
-void app_t::draw() const {
-    glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+void app_t::draw() { draw(1.0); }
 
-    world::model_t::before_drawing(world.camera);
+void app_t::draw(double alpha) {
+    auto now = glfwGetTime();
+    if (m_collect_frame_stats && m_last_draw >= 0.0)
+        m_frame_stats.add(now - m_last_draw);
+    m_last_draw = now;
 
-    for (auto const &model : world.models) {
-        model->draw();
+    int width, height;
+    glfwGetWindowSize(m_window, &width, &height);
+    world.models.sync();
+
+    auto &snapshot = m_render_thread ? m_render_thread->back() : m_snapshot;
+    if (m_render_thread)
+        m_render_thread->rethrow_if_failed();
+    snapshot.capture(world, ui, width, height, m_render_thread != nullptr);
+    snapshot.captures.clear();
+    snapshot.captures.swap(m_pending_captures);
+    if (m_recording)
+        snapshot.captures.push_back(m_recording);
+
+    // a frame between two steps has to be followed by one showing the
+    // latest step, even when nothing changes anymore
+    m_redraw = interpolate(snapshot, alpha);
+    m_drawn_version = world.models.version();
+    m_drawn_view = world.camera.view();
+    m_drawn_width = width;
+    m_drawn_height = height;
+
+    if (m_render_thread) {
+        m_render_thread->publish();
+    } else {
+        m_renderer->render(snapshot);
+        glfwSwapBuffers(m_window);
     }
 
-    font::before_drawing();
-    using text_rendering_info_t =
-        std::pair<std::vector<glm::vec2>, std::vector<glm::vec2>>;
-    std::unordered_map<int, text_rendering_info_t> text_rendering_infos;
+    glfwPollEvents();
+
+    if (m_render_thread)
+        m_render_thread->rethrow_capture_error();
+    else
+        m_renderer->rethrow_capture_error();
+}
 
-    for (auto const &text : ui.texts_2d) {
-        text_rendering_info_t &info = text_rendering_infos[text->font_size];
-        text->append(info.first, info.second);
+void app_t::capture(std::string const &path) {
+    m_pending_captures.push_back(detail::make_png_target(path));
+    m_redraw = true;
+}
+
+void app_t::start_recording(std::string const &path, int fps) {
+    m_recording = detail::make_y4m_target(path, fps);
+}
+
+void app_t::save_transforms() {
+    world.models.sync();
+    m_previous_transforms = world.models.transforms();
+    m_previous_handles.resize(world.models.size());
+    for (std::size_t i = 0; i < world.models.size(); i++)
+        m_previous_handles[i] = world.models.handle(i);
+}
+
+// blends two transforms by their translation, rotation and scale, so that
+// rotating objects keep their shape. shear is not preserved.
+static matrix_t blend_transforms(matrix_t const &from, matrix_t const &to,
+                                 float a) {
+    struct trs_t {
+        glm::vec3 translation;
+        glm::quat rotation;
+        glm::vec3 scale;
+    };
+    auto decompose = [](matrix_t const &m, trs_t &trs) {
+        glm::mat3 basis{m};
+        for (int i = 0; i < 3; i++) {
+            trs.scale[i] = glm::length(basis[i]);
+            if (trs.scale[i] < 1e-6f)
+                return false;
+        }
+        // a mirroring transform is a rotation with one negative scale
+        if (glm::dot(glm::cross(basis[0], basis[1]), basis[2]) < 0.f)
+            trs.scale.x = -trs.scale.x;
+        for (int i = 0; i < 3; i++)
+            basis[i] /= trs.scale[i];
+        trs.rotation = glm::quat_cast(basis);
+        trs.translation = glm::vec3{m[3]};
+        return true;
+    };
+    trs_t from_trs, to_trs;
+    if (!decompose(from, from_trs) || !decompose(to, to_trs))
+        return from + (to - from) * a;
+
+    auto rotation = glm::slerp(from_trs.rotation, to_trs.rotation, a);
+    auto scale = glm::mix(from_trs.scale, to_trs.scale, a);
+    matrix_t result = glm::toMat4(rotation);
+    for (int i = 0; i < 3; i++)
+        result[i] *= scale[i];
+    result[3] =
+        glm::vec4{glm::mix(from_trs.translation, to_trs.translation, a), 1.f};
+    return result;
+}
+
+bool app_t::interpolate(snapshot_t &snapshot, double alpha) const {
+    if (alpha >= 1.0)
+        return false;
+    auto a = static_cast<float>(alpha);
+    snapshot.view = world.camera.view(alpha);
+    bool differs = snapshot.view != world.camera.view();
+
+    // elements were added, removed or reordered since the previous step
+    auto const &models = world.models;
+    if (m_previous_handles.size() != models.size())
+        return differs;
+    for (std::size_t i = 0; i < models.size(); i++) {
+        if (m_previous_handles[i] != models.handle(i))
+            return differs;
     }
-    glm::mat4 MVP = world.camera.projection() * world.camera.view();
-    for (auto const &text : world.texts_3d) {
-        text_rendering_info_t &info = text_rendering_infos[text->font_size];
-        text->append(m_window, MVP, info.first, info.second);
+    for (std::size_t i = 0; i < models.size(); i++) {
+        auto const &previous = m_previous_transforms[i];
+        auto const &current = snapshot.model_matrices[i];
+        if (previous == current)
+            continue;
+        snapshot.model_matrices[i] = blend_transforms(previous, current, a);
+        differs = true;
     }
+    return differs;
+}
 
-    for (auto const &info : text_rendering_infos) {
-        font::render(m_window, info.first, info.second.first,
-                     info.second.second);
-    }
+bool app_t::needs_redraw() {
+    int width, height;
+    glfwGetWindowSize(m_window, &width, &height);
+    world.models.sync();
+    // a recording needs every frame
+    return m_redraw || m_recording ||
+           world.models.version() != m_drawn_version ||
+           world.camera.view() != m_drawn_view || width != m_drawn_width ||
+           height != m_drawn_height;
+}
 
-    glfwSwapBuffers(m_window);
-    glfwPollEvents();
+// sleeps coarsely until shortly before the deadline and yields for the
+// rest, since sleeps may overshoot by the scheduler's granularity
+static void sleep_until(double deadline) {
+    constexpr double SPIN = 0.002;
+    auto remaining = deadline - glfwGetTime();
+    if (remaining > SPIN)
+        std::this_thread::sleep_for(
+            std::chrono::duration<double>(remaining - SPIN));
+    while (glfwGetTime() < deadline)
+        std::this_thread::yield();
+}
+
+void app_t::run(std::function<void(double)> const &step) {
+    // longer frames are dropped instead of being caught up with, so that
+    // a slow frame does not cause more slow frames
+    constexpr double MAX_FRAME_TIME = 0.25;
+
+    auto previous = glfwGetTime();
+    double accumulator = 0.0;
+    while (!should_close()) {
+        auto frame_start = glfwGetTime();
+        if (m_player)
+            accumulator = m_timestep;
+        else
+            accumulator += std::min(frame_start - previous, MAX_FRAME_TIME);
+        previous = frame_start;
+
+        while (accumulator >= m_timestep) {
+            save_transforms();
+            update();
+            if (step)
+                step(m_timestep);
+            accumulator -= m_timestep;
+        }
+
+        if (!m_on_demand || needs_redraw()) {
+            draw(m_player ? 1.0 : accumulator / m_timestep);
+        } else {
+            // idle; wake up for input or the next step
+            glfwWaitEventsTimeout(m_timestep - accumulator);
+        }
+
+        if (m_max_fps > 0.0)
+            sleep_until(frame_start + 1.0 / m_max_fps);
+    }
 }
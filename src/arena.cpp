@@ -0,0 +1,73 @@
+#include <algorithm>
+#include <cstdint>
+
+#include <protowork/arena.hpp>
+#include <protowork/memory.hpp>
+
+using namespace protowork;
+using namespace protowork::detail;
+
+frame_arena_t::frame_arena_t(std::pmr::memory_resource *upstream)
+    : m_upstream{upstream} {}
+
+frame_arena_t::~frame_arena_t() {
+    release();
+    memory::untrack_host(this);
+}
+
+void frame_arena_t::reset() {
+    // the next frame likely needs as much as this one
+    if (m_blocks.size() > 1) {
+        auto size = capacity();
+        release();
+        add_block(size);
+    }
+    m_offset = 0;
+    m_used = 0;
+}
+
+std::size_t frame_arena_t::capacity() const {
+    std::size_t size = 0;
+    for (auto const &block : m_blocks)
+        size += block.size;
+    return size;
+}
+
+void *frame_arena_t::do_allocate(std::size_t bytes, std::size_t alignment) {
+    auto fits = [&] {
+        if (m_blocks.empty())
+            return false;
+        auto const &block = m_blocks.back();
+        auto address = reinterpret_cast<std::uintptr_t>(block.data);
+        auto begin = (address + m_offset + alignment - 1) & ~(alignment - 1);
+        if (begin + bytes > address + block.size)
+            return false;
+        m_offset = begin - address;
+        return true;
+    };
+    if (!fits()) {
+        add_block(std::max(BLOCK_SIZE, bytes + alignment));
+        fits();
+    }
+    auto *result = m_blocks.back().data + m_offset;
+    m_offset += bytes;
+    m_used += bytes;
+    return result;
+}
+
+void frame_arena_t::add_block(std::size_t size) {
+    auto *data = static_cast<std::byte *>(
+        m_upstream->allocate(size, alignof(std::max_align_t)));
+    m_blocks.push_back(block_t{data, size});
+    m_offset = 0;
+    m_n_upstream++;
+    memory::track_host(this, capacity(), memory::FRAME, "frame arena");
+}
+
+void frame_arena_t::release() {
+    for (auto const &block : m_blocks)
+        m_upstream->deallocate(block.data, block.size,
+                               alignof(std::max_align_t));
+    m_blocks.clear();
+    m_offset = 0;
+}
@@ -0,0 +1,163 @@
+#include <array>
+#include <numeric>
+
+#include <protowork/world/bvh.hpp>
+
+using namespace protowork;
+using namespace protowork::world;
+
+static constexpr std::uint32_t MAX_LEAF_SIZE = 4;
+static constexpr std::size_t N_BINS = 12;
+// deeper subtrees are split at the median so traversal stacks stay small
+static constexpr int MAX_SAH_DEPTH = 32;
+
+float world::intersect(ray_t const &ray, glm::vec3 const &inv_direction,
+                       aabb_t const &box, float t_max) {
+    auto t0 = (box.min - ray.origin) * inv_direction;
+    auto t1 = (box.max - ray.origin) * inv_direction;
+    auto near = glm::min(t0, t1);
+    auto far = glm::max(t0, t1);
+    auto enter = std::max(std::max(near.x, near.y), std::max(near.z, 0.f));
+    auto exit = std::min(std::min(far.x, far.y), std::min(far.z, t_max));
+    return enter <= exit ? enter : -1.f;
+}
+
+static float area(aabb_t const &box) {
+    if (box.empty())
+        return 0.f;
+    auto d = box.max - box.min;
+    return d.x * d.y + d.y * d.z + d.z * d.x;
+}
+
+static void merge(aabb_t &box, aabb_t const &other) {
+    box.min = glm::min(box.min, other.min);
+    box.max = glm::max(box.max, other.max);
+}
+
+namespace {
+
+struct builder_t {
+    std::vector<aabb_t> const &boxes;
+    std::vector<pos_t> centroids;
+    bvh_t &bvh;
+
+    std::uint32_t build(std::uint32_t begin, std::uint32_t end, int depth) {
+        auto index = static_cast<std::uint32_t>(bvh.nodes.size());
+        bvh.nodes.emplace_back();
+
+        aabb_t bounds, centroid_bounds;
+        for (auto i = begin; i < end; i++) {
+            merge(bounds, boxes[bvh.primitives[i]]);
+            centroid_bounds.extend(centroids[bvh.primitives[i]]);
+        }
+        bvh.nodes[index].bounds = bounds;
+
+        auto count = end - begin;
+        auto mid = count <= MAX_LEAF_SIZE ? begin : split(begin, end, bounds,
+                                                          centroid_bounds,
+                                                          depth);
+        if (mid == begin || mid == end) {
+            bvh.nodes[index].first = begin;
+            bvh.nodes[index].count = count;
+            return index;
+        }
+
+        build(begin, mid, depth + 1);
+        auto right = build(mid, end, depth + 1);
+        bvh.nodes[index].first = right;
+        bvh.nodes[index].count = 0;
+        return index;
+    }
+
+    // partitions [begin, end) and returns the split position; returning
+    // begin makes the node a leaf
+    std::uint32_t split(std::uint32_t begin, std::uint32_t end,
+                        aabb_t const &bounds, aabb_t const &centroid_bounds,
+                        int depth) {
+        auto extent = centroid_bounds.max - centroid_bounds.min;
+        int axis = 0;
+        if (extent.y > extent[axis])
+            axis = 1;
+        if (extent.z > extent[axis])
+            axis = 2;
+
+        auto *first = bvh.primitives.data() + begin;
+        auto *last = bvh.primitives.data() + end;
+        auto median_split = [&] {
+            auto *mid = first + (end - begin) / 2;
+            std::nth_element(first, mid, last, [&](auto a, auto b) {
+                return centroids[a][axis] < centroids[b][axis];
+            });
+            return static_cast<std::uint32_t>(mid - bvh.primitives.data());
+        };
+        if (extent[axis] <= 0.f || depth >= MAX_SAH_DEPTH)
+            return median_split();
+
+        auto bin_of = [&](std::uint32_t primitive) {
+            auto t = (centroids[primitive][axis] - centroid_bounds.min[axis]) /
+                     extent[axis];
+            return std::min(static_cast<std::size_t>(t * N_BINS), N_BINS - 1);
+        };
+
+        std::array<aabb_t, N_BINS> bin_bounds;
+        std::array<std::uint32_t, N_BINS> bin_counts{};
+        for (auto *p = first; p != last; p++) {
+            auto bin = bin_of(*p);
+            merge(bin_bounds[bin], boxes[*p]);
+            bin_counts[bin]++;
+        }
+
+        // sweep from the right to get the cost of every right side
+        std::array<float, N_BINS> right_costs{};
+        aabb_t right_bounds;
+        std::uint32_t right_count = 0;
+        for (auto bin = N_BINS - 1; bin > 0; bin--) {
+            merge(right_bounds, bin_bounds[bin]);
+            right_count += bin_counts[bin];
+            right_costs[bin] = area(right_bounds) * right_count;
+        }
+
+        auto best_cost = std::numeric_limits<float>::max();
+        std::size_t best_bin = 0;
+        aabb_t left_bounds;
+        std::uint32_t left_count = 0;
+        for (std::size_t bin = 1; bin < N_BINS; bin++) {
+            merge(left_bounds, bin_bounds[bin - 1]);
+            left_count += bin_counts[bin - 1];
+            auto cost = area(left_bounds) * left_count + right_costs[bin];
+            if (cost < best_cost) {
+                best_cost = cost;
+                best_bin = bin;
+            }
+        }
+
+        auto leaf_cost = area(bounds) * (end - begin);
+        if (end - begin <= MAX_LEAF_SIZE * 4 && leaf_cost <= best_cost)
+            return begin;
+
+        auto *mid = std::partition(first, last, [&](auto primitive) {
+            return bin_of(primitive) < best_bin;
+        });
+        if (mid == first || mid == last)
+            return median_split();
+        return static_cast<std::uint32_t>(mid - bvh.primitives.data());
+    }
+};
+
+} // namespace
+
+void bvh_t::build(std::vector<aabb_t> const &boxes) {
+    nodes.clear();
+    primitives.resize(boxes.size());
+    std::iota(primitives.begin(), primitives.end(), 0);
+    if (boxes.empty())
+        return;
+
+    builder_t builder{boxes, {}, *this};
+    builder.centroids.reserve(boxes.size());
+    for (auto const &box : boxes)
+        builder.centroids.push_back((box.min + box.max) * 0.5f);
+
+    nodes.reserve(boxes.size() * 2);
+    builder.build(0, boxes.size(), 0);
+}
@@ -1,3 +1,4 @@
+#include <cmath>
 #include <iostream>
 #include <GL/glew.h>
 #include <GLFW/glfw3.h>
@@ -8,10 +9,10 @@
 
 using namespace protowork::world;
 
-camera_t::camera_t() { m_orientation = glm::quat{0.f, 0.f, 0.f, 1.f}; }
-
-static double prev_mouse_x = 0.0;
-static double prev_mouse_y = 0.0;
+camera_t::camera_t() {
+    m_orientation = glm::quat{0.f, 0.f, 0.f, 1.f};
+    m_previous_orientation = m_orientation;
+}
 
 void make_up_and_right_from_forward(glm::vec3 &up, glm::vec3 &right,
                                     glm::vec3 const &forward) {
@@ -19,36 +20,82 @@ void make_up_and_right_from_forward(glm::vec3 &up, glm::vec3 &right,
     up = glm::cross(right, forward);
 }
 
-void camera_t::update(input_t const &input) {
+void camera_t::orbit(float yaw, float pitch) {
+    float roll = 0.f;
+    glm::quat diff_orientation{glm::vec3{pitch, yaw, roll}};
+    m_orientation *= diff_orientation;
+    m_orientation = glm::normalize(m_orientation);
+}
+
+void camera_t::pan(float dx, float dy) {
+    auto up = glm::vec3{0.f, 1.f, 0.f} * m_orientation;
+    auto right = glm::vec3{1.f, 0.f, 0.f} * m_orientation;
+    m_target_pos += (dx * 0.01f) * right;
+    m_target_pos += -(dy * 0.01f) * up;
+}
+
+void camera_t::update(input_t const &input, double dt) {
     using button_t = input_t::mouse_t::button_t;
-    using button_state_t = input_t::mouse_t::button_state_t;
-    auto const &buttons = input.mouse.buttons;
-    auto is_left = buttons[button_t::LEFT] != button_state_t::RELEASED;
-    auto is_right = buttons[button_t::RIGHT] != button_state_t::RELEASED;
-    auto is_middle = buttons[button_t::MIDDLE] != button_state_t::RELEASED;
+    constexpr float KEY_SPEED = 1.5f; // radians per second
 
-    float diff_x = input.mouse.x - prev_mouse_x;
-    float diff_y = input.mouse.y - prev_mouse_y;
+    m_previous_orientation = m_orientation;
+    m_previous_distance = m_distance;
+    m_previous_target_pos = m_target_pos;
 
-    if (is_left && !is_right && !is_middle) {
-        // rotation around the target
-        float yaw = diff_x / 100.f;
-        float pitch = diff_y / 100.f;
-        float roll = 0.f;
-        glm::quat diff_orientation{glm::vec3{pitch, yaw, roll}};
-        m_orientation *= diff_orientation;
-        m_orientation = glm::normalize(m_orientation);
-    } else if (!is_left && !is_right && is_middle) {
-        // translation
-        auto inv = glm::inverse(m_orientation);
-        auto up = glm::vec3{0.f, 1.f, 0.f} * m_orientation;
-        auto right = glm::vec3{1.f, 0.f, 0.f} * m_orientation;
-        m_target_pos += (diff_x * 0.01f) * right;
-        m_target_pos += -(diff_y * 0.01f) * up;
+    if (!m_has_mouse && !input.events.empty()) {
+        // the position before the first event of the first frame
+        m_mouse_x = input.mouse.x;
+        m_mouse_y = input.mouse.y;
+        for (auto const &event : input.events) {
+            if (event.kind == event_t::kind_t::MOUSE_MOVE) {
+                m_mouse_x = event.x;
+                m_mouse_y = event.y;
+                break;
+            }
+        }
+        m_has_mouse = true;
     }
 
-    prev_mouse_x = input.mouse.x;
-    prev_mouse_y = input.mouse.y;
+    for (auto const &event : input.events) {
+        switch (event.kind) {
+        case event_t::kind_t::MOUSE_MOVE: {
+            float diff_x = event.x - m_mouse_x;
+            float diff_y = event.y - m_mouse_y;
+            m_mouse_x = event.x;
+            m_mouse_y = event.y;
+
+            auto is_left = m_buttons[button_t::LEFT];
+            auto is_right = m_buttons[button_t::RIGHT];
+            auto is_middle = m_buttons[button_t::MIDDLE];
+            if (is_left && !is_right && !is_middle)
+                orbit(diff_x / 100.f, diff_y / 100.f);
+            else if (!is_left && !is_right && is_middle)
+                pan(diff_x, diff_y);
+            break;
+        }
+        case event_t::kind_t::MOUSE_BUTTON:
+            if (event.code >= 0 && event.code < button_t::N_BUTTONS)
+                m_buttons[event.code] =
+                    event.action != event_t::action_t::RELEASE;
+            break;
+        case event_t::kind_t::SCROLL:
+            m_distance =
+                glm::clamp(m_distance * std::pow(0.9f, float(event.y)), 0.5f,
+                           50.f);
+            break;
+        case event_t::kind_t::KEY:
+            break;
+        }
+    }
+
+    auto const &keyboard = input.keyboard;
+    float step = KEY_SPEED * dt;
+    float yaw = (keyboard.is_down(GLFW_KEY_RIGHT) ? step : 0.f) -
+                (keyboard.is_down(GLFW_KEY_LEFT) ? step : 0.f);
+    float pitch = (keyboard.is_down(GLFW_KEY_DOWN) ? step : 0.f) -
+                  (keyboard.is_down(GLFW_KEY_UP) ? step : 0.f);
+    if (yaw != 0.f || pitch != 0.f)
+        orbit(yaw, pitch);
 }
 
 glm::mat4 camera_t::projection() const {
@@ -56,10 +103,15 @@ glm::mat4 camera_t::projection() const {
     return glm::perspective(glm::radians(FOV), 4.0f / 3.0f, 0.1f, 100.0f);
 }
 
-glm::mat4 camera_t::view() const {
-    auto forward = glm::normalize(glm::vec3{0.f, 0.f, -1.f} * m_orientation);
-    auto origin_pos = m_target_pos - m_distance * forward;
+glm::mat4 camera_t::view(double alpha) const {
+    auto a = static_cast<float>(alpha);
+    auto orientation = glm::slerp(m_previous_orientation, m_orientation, a);
+    auto distance = glm::mix(m_previous_distance, m_distance, a);
+    auto target_pos = glm::mix(m_previous_target_pos, m_target_pos, a);
+
+    auto forward = glm::normalize(glm::vec3{0.f, 0.f, -1.f} * orientation);
+    auto origin_pos = target_pos - distance * forward;
     glm::vec3 up, right;
     make_up_and_right_from_forward(up, right, forward);
-    return glm::lookAt(origin_pos, m_target_pos, up);
+    return glm::lookAt(origin_pos, target_pos, up);
 }
@@ -0,0 +1,349 @@
+#include <algorithm>
+#include <array>
+#include <cstring>
+#include <fstream>
+#include <stdexcept>
+#include <utility>
+
+#include <GL/glew.h>
+
+#include <protowork/capture.hpp>
+#include <protowork/gl.hpp>
+#include <protowork/memory.hpp>
+
+using namespace protowork;
+using namespace protowork::detail;
+
+namespace {
+
+std::uint32_t crc32(std::uint32_t crc, std::uint8_t const *data,
+                    std::size_t size) {
+    static auto const table = [] {
+        std::array<std::uint32_t, 256> table;
+        for (std::uint32_t i = 0; i < 256; i++) {
+            auto c = i;
+            for (int k = 0; k < 8; k++)
+                c = (c & 1) ? 0xedb88320u ^ (c >> 1) : c >> 1;
+            table[i] = c;
+        }
+        return table;
+    }();
+    crc = ~crc;
+    for (std::size_t i = 0; i < size; i++)
+        crc = table[(crc ^ data[i]) & 0xff] ^ (crc >> 8);
+    return ~crc;
+}
+
+void put_u32(std::vector<std::uint8_t> &out, std::uint32_t value) {
+    out.push_back(value >> 24);
+    out.push_back(value >> 16);
+    out.push_back(value >> 8);
+    out.push_back(value);
+}
+
+void write_chunk(std::ofstream &out, char const *type,
+                 std::vector<std::uint8_t> const &data) {
+    std::vector<std::uint8_t> chunk;
+    put_u32(chunk, data.size());
+    chunk.insert(chunk.end(), type, type + 4);
+    chunk.insert(chunk.end(), data.begin(), data.end());
+    put_u32(chunk, crc32(0, chunk.data() + 4, chunk.size() - 4));
+    out.write(reinterpret_cast<char const *>(chunk.data()), chunk.size());
+}
+
+// 8-bit RGB PNG. the image data is stored in uncompressed deflate blocks,
+// which keeps encoding cheap and needs no zlib.
+struct png_target_t : capture_target_t {
+    explicit png_target_t(std::string const &path)
+        : m_path{path}, m_out{path, std::ios::binary | std::ios::trunc} {
+        if (!m_out)
+            throw std::runtime_error{"failed to create " + path};
+    }
+
+    void write(int width, int height, std::uint8_t const *rgba) override {
+        if (m_written)
+            return;
+        m_written = true;
+
+        static std::uint8_t const SIGNATURE[8] = {0x89, 'P',  'N',  'G',
+                                                  '\r', '\n', 0x1a, '\n'};
+        m_out.write(reinterpret_cast<char const *>(SIGNATURE),
+                    sizeof(SIGNATURE));
+
+        std::vector<std::uint8_t> header;
+        put_u32(header, width);
+        put_u32(header, height);
+        header.insert(header.end(), {8, 2, 0, 0, 0}); // 8-bit RGB
+        write_chunk(m_out, "IHDR", header);
+
+        // filter type 0 and RGB per row, top row first
+        std::size_t row_size = 1 + std::size_t(width) * 3;
+        std::vector<std::uint8_t> raw(row_size * height);
+        for (int y = 0; y < height; y++) {
+            auto *row = &raw[y * row_size];
+            auto const *src = rgba + std::size_t(height - 1 - y) * width * 4;
+            row[0] = 0;
+            for (int x = 0; x < width; x++)
+                std::memcpy(&row[1 + x * 3], &src[x * 4], 3);
+        }
+
+        std::vector<std::uint8_t> zlib{0x78, 0x01};
+        std::uint32_t a = 1, b = 0;
+        for (auto byte : raw) {
+            a = (a + byte) % 65521;
+            b = (b + a) % 65521;
+        }
+        std::size_t offset = 0;
+        do {
+            std::size_t size = std::min<std::size_t>(raw.size() - offset,
+                                                     65535);
+            bool last = offset + size == raw.size();
+            zlib.push_back(last ? 1 : 0);
+            zlib.push_back(size & 0xff);
+            zlib.push_back(size >> 8);
+            zlib.push_back(~size & 0xff);
+            zlib.push_back((~size >> 8) & 0xff);
+            zlib.insert(zlib.end(), raw.begin() + offset,
+                        raw.begin() + offset + size);
+            offset += size;
+        } while (offset < raw.size());
+        put_u32(zlib, (b << 16) | a);
+        write_chunk(m_out, "IDAT", zlib);
+        write_chunk(m_out, "IEND", {});
+
+        m_out.flush();
+        if (!m_out)
+            throw std::runtime_error{"failed to write " + m_path};
+    }
+
+private:
+    std::string m_path;
+    std::ofstream m_out;
+    bool m_written = false;
+};
+
+// YUV4MPEG2 with full range BT.601 4:2:0 frames. the first frame fixes the
+// size; frames of another size are skipped.
+struct y4m_target_t : capture_target_t {
+    y4m_target_t(std::string const &path, int fps)
+        : m_path{path}, m_out{path, std::ios::binary | std::ios::trunc},
+          m_fps{fps} {
+        if (!m_out)
+            throw std::runtime_error{"failed to create " + path};
+    }
+
+    void write(int width, int height, std::uint8_t const *rgba) override {
+        if (m_width == 0) {
+            m_width = width;
+            m_height = height;
+            m_out << "YUV4MPEG2 W" << width << " H" << height << " F" << m_fps
+                  << ":1 Ip A1:1 C420jpeg\n";
+        }
+        if (width != m_width || height != m_height)
+            return;
+
+        int chroma_width = (width + 1) / 2;
+        int chroma_height = (height + 1) / 2;
+        m_planes.resize(std::size_t(width) * height +
+                        2 * std::size_t(chroma_width) * chroma_height);
+        auto *y_plane = m_planes.data();
+        auto *u_plane = y_plane + std::size_t(width) * height;
+        auto *v_plane = u_plane + std::size_t(chroma_width) * chroma_height;
+
+        auto pixel = [&](int x, int y) {
+            // rows are bottom to top
+            return rgba + (std::size_t(height - 1 - y) * width + x) * 4;
+        };
+        for (int y = 0; y < height; y++) {
+            for (int x = 0; x < width; x++) {
+                auto const *p = pixel(x, y);
+                y_plane[std::size_t(y) * width + x] = static_cast<std::uint8_t>(
+                    0.299f * p[0] + 0.587f * p[1] + 0.114f * p[2] + 0.5f);
+            }
+        }
+        for (int cy = 0; cy < chroma_height; cy++) {
+            for (int cx = 0; cx < chroma_width; cx++) {
+                float r = 0.f, g = 0.f, b = 0.f;
+                int n = 0;
+                for (int y = cy * 2; y < std::min(cy * 2 + 2, height); y++) {
+                    for (int x = cx * 2; x < std::min(cx * 2 + 2, width); x++) {
+                        auto const *p = pixel(x, y);
+                        r += p[0];
+                        g += p[1];
+                        b += p[2];
+                        n++;
+                    }
+                }
+                r /= n;
+                g /= n;
+                b /= n;
+                auto i = std::size_t(cy) * chroma_width + cx;
+                u_plane[i] = static_cast<std::uint8_t>(std::clamp(
+                    128.f - 0.168736f * r - 0.331264f * g + 0.5f * b + 0.5f,
+                    0.f, 255.f));
+                v_plane[i] = static_cast<std::uint8_t>(std::clamp(
+                    128.f + 0.5f * r - 0.418688f * g - 0.081312f * b + 0.5f,
+                    0.f, 255.f));
+            }
+        }
+
+        m_out << "FRAME\n";
+        m_out.write(reinterpret_cast<char const *>(m_planes.data()),
+                    m_planes.size());
+        if (!m_out)
+            throw std::runtime_error{"failed to write " + m_path};
+    }
+
+private:
+    std::string m_path;
+    std::ofstream m_out;
+    int m_fps;
+    int m_width = 0;
+    int m_height = 0;
+    std::vector<std::uint8_t> m_planes;
+};
+
+} // namespace
+
+std::shared_ptr<capture_target_t>
+detail::make_png_target(std::string const &path) {
+    return std::make_shared<png_target_t>(path);
+}
+
+std::shared_ptr<capture_target_t>
+detail::make_y4m_target(std::string const &path, int fps) {
+    return std::make_shared<y4m_target_t>(path, fps);
+}
+
+frame_capture_t::frame_capture_t() {
+    m_encoder = std::thread{[this] { run_encoder(); }};
+}
+
+frame_capture_t::~frame_capture_t() {
+    poll(true);
+    {
+        std::lock_guard lock{m_mutex};
+        m_stop = true;
+    }
+    m_condition.notify_one();
+    m_encoder.join();
+
+    for (auto &slot : m_slots) {
+        if (slot.buffer_id != 0)
+            gl::delete_buffers(1, &slot.buffer_id);
+    }
+}
+
+void frame_capture_t::read(int width, int height,
+                           capture_targets_t const &targets) {
+    poll(false);
+    if (m_n_pending == N_SLOTS)
+        retire_oldest(true);
+
+    auto &slot = m_slots[(m_head + m_n_pending) % N_SLOTS];
+    std::size_t size = std::size_t(width) * height * 4;
+    if (slot.buffer_id == 0)
+        glCreateBuffers(1, &slot.buffer_id);
+    if (slot.capacity < size) {
+        glNamedBufferData(slot.buffer_id, size, nullptr, GL_STREAM_READ);
+        slot.capacity = size;
+        memory::track_buffer(slot.buffer_id, size, memory::READBACK,
+                             "frame capture");
+    }
+
+    // with a pack buffer bound, glReadPixels only queues the copy. the
+    // binding is not cached by gl::, so it is restored right away.
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, slot.buffer_id);
+    glPixelStorei(GL_PACK_ALIGNMENT, 4);
+    glReadPixels(0, 0, width, height, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+
+    slot.fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    slot.width = width;
+    slot.height = height;
+    slot.targets = targets;
+    m_n_pending++;
+}
+
+void frame_capture_t::poll(bool wait) {
+    while (m_n_pending > 0 && retire_oldest(wait)) {
+    }
+}
+
+bool frame_capture_t::retire_oldest(bool wait) {
+    auto &slot = m_slots[m_head];
+    auto status = glClientWaitSync(slot.fence, GL_SYNC_FLUSH_COMMANDS_BIT,
+                                   wait ? GL_TIMEOUT_IGNORED : 0);
+    if (status == GL_TIMEOUT_EXPIRED)
+        return false;
+    glDeleteSync(slot.fence);
+    slot.fence = nullptr;
+
+    job_t job{std::move(slot.targets), slot.width, slot.height, {}};
+    slot.targets.clear();
+    m_head = (m_head + 1) % N_SLOTS;
+    m_n_pending--;
+
+    // when encoding falls behind, frames wait here instead of piling up
+    std::unique_lock lock{m_mutex};
+    m_dequeued.wait(lock, [this] { return m_jobs.size() < MAX_JOBS; });
+    if (!m_free.empty()) {
+        job.pixels = std::move(m_free.back());
+        m_free.pop_back();
+    }
+    lock.unlock();
+
+    // the pixels of a failed readback are undefined, so the frame is dropped
+    std::size_t size = std::size_t(job.width) * job.height * 4;
+    auto const *data = status == GL_WAIT_FAILED
+                           ? nullptr
+                           : glMapNamedBufferRange(slot.buffer_id, 0, size,
+                                                   GL_MAP_READ_BIT);
+    if (data) {
+        job.pixels.resize(size);
+        std::memcpy(job.pixels.data(), data, size);
+        glUnmapNamedBuffer(slot.buffer_id);
+    }
+
+    lock.lock();
+    if (data)
+        m_jobs.push_back(std::move(job));
+    else
+        m_free.push_back(std::move(job.pixels));
+    lock.unlock();
+    m_condition.notify_one();
+    return true;
+}
+
+void frame_capture_t::rethrow_if_failed() {
+    std::lock_guard lock{m_mutex};
+    if (m_error)
+        std::rethrow_exception(std::exchange(m_error, nullptr));
+}
+
+void frame_capture_t::run_encoder() {
+    while (true) {
+        job_t job;
+        {
+            std::unique_lock lock{m_mutex};
+            m_condition.wait(lock, [&] { return m_stop || !m_jobs.empty(); });
+            if (m_jobs.empty())
+                return;
+            job = std::move(m_jobs.front());
+            m_jobs.pop_front();
+        }
+        m_dequeued.notify_one();
+        try {
+            for (auto const &target : job.targets)
+                target->write(job.width, job.height, job.pixels.data());
+        } catch (...) {
+            std::lock_guard lock{m_mutex};
+            if (!m_error)
+                m_error = std::current_exception();
+        }
+        // targets are released here, so files are closed on this thread
+        job.targets.clear();
+        std::lock_guard lock{m_mutex};
+        m_free.push_back(std::move(job.pixels));
+    }
+}
@@ -0,0 +1,98 @@
+#include <algorithm>
+#include <array>
+#include <bit>
+
+#include <protowork/command.hpp>
+
+using namespace protowork;
+
+std::uint32_t sort_key::depth_order(float depth) {
+    // the bit pattern of a non-negative float grows with its value
+    return std::bit_cast<std::uint32_t>(std::max(depth, 0.f));
+}
+
+void command_list_t::clear() {
+    packets.clear();
+    for (auto &[_, batch] : m_text_batches) {
+        batch.vertices.clear();
+        batch.uvs.clear();
+    }
+}
+
+void command_list_t::draw_model(std::uint64_t key,
+                                world::model_t const *model,
+                                world::geometry_t const *geometry,
+                                std::uint64_t revision,
+                                matrix_t const &model_matrix,
+                                world::material_t const *material) {
+    auto &packet = packets.emplace_back();
+    packet.key = key;
+    packet.kind = draw_packet_t::kind_t::MODEL;
+    packet.model = model;
+    packet.geometry = geometry;
+    packet.revision = revision;
+    packet.model_matrix = model_matrix;
+    packet.material = material;
+}
+
+command_list_t::text_batch_t &command_list_t::text_batch(int font_size) {
+    return m_text_batches[font_size];
+}
+
+std::size_t command_list_t::capacity_bytes() const {
+    auto bytes = packets.capacity() * sizeof(draw_packet_t);
+    for (auto const &[_, batch] : m_text_batches) {
+        bytes += (batch.vertices.capacity() + batch.uvs.capacity()) *
+                 sizeof(glm::vec2);
+    }
+    return bytes;
+}
+
+void command_list_t::finish() {
+    for (auto const &[font_size, batch] : m_text_batches) {
+        if (batch.vertices.empty())
+            continue;
+        auto &packet = packets.emplace_back();
+        packet.key = sort_key::make(sort_key::OVERLAY, font_size, 0);
+        packet.kind = draw_packet_t::kind_t::TEXT;
+        packet.font_size = font_size;
+        packet.vertices = batch.vertices.data();
+        packet.uvs = batch.uvs.data();
+        packet.vertex_count = batch.vertices.size();
+    }
+}
+
+void protowork::sort_packets(std::vector<command_list_t> const &lists,
+                             std::vector<sorted_packet_t> &order,
+                             std::vector<sorted_packet_t> &scratch) {
+    order.clear();
+    std::uint64_t all_or = 0;
+    std::uint64_t all_and = ~std::uint64_t{0};
+    for (auto const &list : lists) {
+        for (auto const &packet : list.packets) {
+            order.push_back(sorted_packet_t{packet.key, &packet});
+            all_or |= packet.key;
+            all_and &= packet.key;
+        }
+    }
+    scratch.resize(order.size());
+
+    auto varying = all_or ^ all_and;
+    for (int shift = 0; shift < 64; shift += 8) {
+        if (((varying >> shift) & 0xff) == 0)
+            continue;
+
+        std::array<std::size_t, 256> offsets{};
+        for (auto const &item : order)
+            offsets[(item.key >> shift) & 0xff]++;
+        std::size_t sum = 0;
+        for (auto &offset : offsets) {
+            auto n = offset;
+            offset = sum;
+            sum += n;
+        }
+        for (auto const &item : order)
+            scratch[offsets[(item.key >> shift) & 0xff]++] = item;
+        order.swap(scratch);
+    }
+}
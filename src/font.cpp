@@ -1,6 +1,9 @@
+#include <algorithm>
 #include <array>
 #include <vector>
 #include <memory>
+#include <mutex>
+#include <shared_mutex>
 
 #include <ft2build.h>
 #include FT_FREETYPE_H
@@ -9,6 +12,8 @@
 #include <GLFW/glfw3.h>
 
 #include <protowork/font.hpp>
+#include <protowork/gl.hpp>
+#include <protowork/memory.hpp>
 
 namespace pw = protowork;
 
@@ -70,11 +75,16 @@ void main() {
 })";
 
 static id_t g_shader_id;
-static id_t g_texture_sampler_id;
+static id_t g_size_id;
+static id_t g_vertex_array_id;
 static id_t g_vertex_buffer_id;
 static id_t g_uv_buffer_id;
+static int g_screen_width;
+static int g_screen_height;
 static FT_Library g_library;
 static FT_Face g_face;
+// FreeType faces are not thread safe; atlases may be rasterized by loaders
+static std::mutex g_face_mutex;
 
 bool pw::font::operator==(pw::font::key_t const &lhs,
                           pw::font::key_t const &rhs) {
@@ -87,8 +97,14 @@ struct key_hash_t {
     }
 };
 
+// written only on the GL thread, read by render workers and pickers
+static std::shared_mutex g_font_data_mutex;
 static std::unordered_map<pw::font::key_t, pw::font::data_t, key_hash_t>
     g_font_data;
+// frame of the last use of each atlas, for eviction (GL thread only)
+static std::unordered_map<pw::font::key_t, std::uint64_t, key_hash_t>
+    g_last_used;
+static std::uint64_t g_frame = 1;
 
 void pw::font::initialize() {
     auto error = FT_Init_FreeType(&g_library);
@@ -105,123 +121,219 @@ void pw::font::initialize() {
         throw std::runtime_error{"failed to load font file"};
     }
 
-    g_shader_id =
-        detail::load_shader_program(vertex_shader_code, fragment_shader_code);
-    g_texture_sampler_id =
-        glGetUniformLocation(g_shader_id, "u_TextureSampler");
+    g_shader_id = pw::detail::load_shader_program(vertex_shader_code,
+                                                  fragment_shader_code);
+    g_size_id = glGetUniformLocation(g_shader_id, "u_Size");
+    g_screen_width = g_screen_height = -1;
 
+    // the sampler always reads texture unit 0
+    gl::use_program(g_shader_id);
+    glUniform1i(glGetUniformLocation(g_shader_id, "u_TextureSampler"), 0);
+
+    glGenVertexArrays(1, &g_vertex_array_id);
     glGenBuffers(1, &g_vertex_buffer_id);
     glGenBuffers(1, &g_uv_buffer_id);
+
+    gl::bind_vertex_array(g_vertex_array_id);
+    glEnableVertexAttribArray(0);
+    gl::bind_array_buffer(g_vertex_buffer_id);
+    glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, 0, nullptr);
+    glEnableVertexAttribArray(1);
+    gl::bind_array_buffer(g_uv_buffer_id);
+    glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, 0, nullptr);
 }
 
 void pw::font::finalize() {
+    std::unique_lock lock{g_font_data_mutex};
     for (auto const &[_, data] : g_font_data) {
-        glDeleteTextures(1, &data.texture_id);
+        gl::delete_textures(1, &data.texture_id);
     }
-    glDeleteBuffers(1, &g_vertex_buffer_id);
-    glDeleteBuffers(1, &g_uv_buffer_id);
-    glDeleteProgram(g_shader_id);
+    g_font_data.clear();
+    gl::delete_vertex_arrays(1, &g_vertex_array_id);
+    gl::delete_buffers(1, &g_vertex_buffer_id);
+    gl::delete_buffers(1, &g_uv_buffer_id);
+    gl::delete_program(g_shader_id);
+    g_last_used.clear();
 }
 
-void pw::font::before_drawing() { glUseProgram(g_shader_id); }
-
-void pw::font::render(GLFWwindow *window, int font_size,
-                      std::vector<glm::vec2> const &vertices,
-                      std::vector<glm::vec2> const &uvs) {
-    glActiveTexture(GL_TEXTURE0);
-    glBindTexture(GL_TEXTURE_2D,
-                  pw::font::get(font::key_t{font_size}).texture_id);
-    glUniform1i(g_texture_sampler_id, 0);
+void pw::font::before_drawing() {
+    gl::use_program(g_shader_id);
+    gl::bind_vertex_array(g_vertex_array_id);
+    gl::set_capability(GL_BLEND, true);
+    gl::blend_func(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+}
 
-    int width, height;
-    glfwGetWindowSize(window, &width, &height);
-    glUniform2f(glGetUniformLocation(g_shader_id, "u_Size"), (float)width,
-                (float)height);
+void pw::font::render(int screen_width, int screen_height, int font_size,
+                      glm::vec2 const *vertices, glm::vec2 const *uvs,
+                      std::size_t count) {
+    gl::bind_texture_2d(0, pw::font::get(font::key_t{font_size}).texture_id);
+    g_last_used[font::key_t{font_size}] = g_frame;
 
-    glEnableVertexAttribArray(0);
-    glBindBuffer(GL_ARRAY_BUFFER, g_vertex_buffer_id);
-    glBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(glm::vec2),
-                 vertices.data(), GL_STATIC_DRAW);
-    glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, 0, nullptr);
+    if (screen_width != g_screen_width || screen_height != g_screen_height) {
+        glUniform2f(g_size_id, (float)screen_width, (float)screen_height);
+        g_screen_width = screen_width;
+        g_screen_height = screen_height;
+    }
 
-    glEnableVertexAttribArray(1);
-    glBindBuffer(GL_ARRAY_BUFFER, g_uv_buffer_id);
-    glBufferData(GL_ARRAY_BUFFER, uvs.size() * sizeof(glm::vec2), uvs.data(),
+    gl::bind_array_buffer(g_vertex_buffer_id);
+    glBufferData(GL_ARRAY_BUFFER, count * sizeof(glm::vec2), vertices,
                  GL_STATIC_DRAW);
-    glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, 0, nullptr);
+    gl::bind_array_buffer(g_uv_buffer_id);
+    glBufferData(GL_ARRAY_BUFFER, count * sizeof(glm::vec2), uvs,
+                 GL_STATIC_DRAW);
+    for (auto buffer_id : {g_vertex_buffer_id, g_uv_buffer_id})
+        memory::track_buffer(buffer_id, count * sizeof(glm::vec2),
+                             memory::FRAME, "text vertices");
 
-    glEnable(GL_BLEND);
-    glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
-    glDrawArrays(GL_TRIANGLES, 0, vertices.size());
-    glDisable(GL_BLEND);
+    glDrawArrays(GL_TRIANGLES, 0, count);
+}
 
-    glDisableVertexAttribArray(0);
-    glDisableVertexAttribArray(1);
+pw::font::data_t const *pw::font::find(pw::font::key_t const &key) {
+    std::shared_lock lock{g_font_data_mutex};
+    auto found = g_font_data.find(key);
+    return found == g_font_data.end() ? nullptr : &found->second;
 }
 
 pw::font::data_t const &pw::font::get(pw::font::key_t const &key) {
-    auto found = g_font_data.find(key);
-    if (found == g_font_data.end()) {
-        FT_Set_Pixel_Sizes(g_face, 0, key.font_size);
-
-        data_t data;
-
-        // calc text texture size
-        int w = 0;
-        int h = 0;
-        for (int i = 32; i < 128; i++) {
-            if (FT_Load_Char(g_face, i, FT_LOAD_RENDER)) {
-                throw std::runtime_error{"failed to load charactor: " +
-                                         std::string{(char)i}};
-            }
-            auto const &bitmap = g_face->glyph->bitmap;
-            w += bitmap.width;
-            h = std::max(h, (int)bitmap.rows);
-        }
-        data.atlas_width = w;
-        data.atlas_height = h;
-
-        // create empty texture with width x height
-        glGenTextures(1, &data.texture_id);
-        glBindTexture(GL_TEXTURE_2D, data.texture_id);
-        glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
-        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, w, h, 0, GL_RGBA,
-                     GL_UNSIGNED_BYTE, nullptr);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
-
-        // write font glyph bitmap to texture
-        int x = 0;
-        for (int i = 32; i < 128; i++) {
-            if (FT_Load_Char(g_face, i, FT_LOAD_RENDER))
+    {
+        // the loader may publish a texture concurrently, so it is read
+        // under the lock
+        std::shared_lock lock{g_font_data_mutex};
+        auto found = g_font_data.find(key);
+        // metrics of evicted atlases stay published; only the texture is
+        // made again
+        if (found != g_font_data.end() && found->second.texture_id != 0)
+            return found->second;
+    }
+    auto atlas = detail::rasterize(key);
+    detail::upload(atlas);
+    return detail::insert(key, std::move(atlas));
+}
+
+std::uint64_t pw::font::atlas_bytes(data_t const &data) {
+    return std::uint64_t(data.atlas_width) * data.atlas_height;
+}
+
+void pw::font::evict(std::uint64_t budget,
+                     std::pmr::memory_resource *resource) {
+    std::uint64_t resident = 0;
+    std::pmr::vector<std::pair<std::uint64_t, data_t *>> unused{resource};
+    {
+        std::shared_lock lock{g_font_data_mutex};
+        for (auto &[key, data] : g_font_data) {
+            if (data.texture_id == 0)
                 continue;
-            auto glyph = g_face->glyph;
-            int glyph_w = glyph->bitmap.width;
-            int glyph_h = glyph->bitmap.rows;
-            std::vector<GLubyte> buf(glyph_w * glyph_h * 4);
-            for (int i = 0; i < glyph_h * glyph_w; i++) {
-                buf[i * 4 + 0] = glyph->bitmap.buffer[i];
-                buf[i * 4 + 1] = glyph->bitmap.buffer[i];
-                buf[i * 4 + 2] = glyph->bitmap.buffer[i];
-                buf[i * 4 + 3] = glyph->bitmap.buffer[i];
+            resident += atlas_bytes(data);
+            auto last_used = g_last_used[key];
+            if (last_used < g_frame)
+                unused.emplace_back(last_used, &data);
+        }
+    }
+    g_frame++;
+    if (resident <= budget)
+        return;
+
+    // least recently used first; atlases of the current frame stay
+    std::sort(unused.begin(), unused.end(),
+              [](auto const &a, auto const &b) { return a.first < b.first; });
+    std::unique_lock lock{g_font_data_mutex};
+    for (auto [_, data] : unused) {
+        if (resident <= budget)
+            break;
+        resident -= atlas_bytes(*data);
+        gl::delete_textures(1, &data->texture_id);
+        data->texture_id = 0;
+    }
+}
+
+pw::font::detail::atlas_t
+pw::font::detail::rasterize(pw::font::key_t const &key) {
+    std::lock_guard lock{g_face_mutex};
+    FT_Set_Pixel_Sizes(g_face, 0, key.font_size);
+
+    atlas_t atlas;
+    auto &data = atlas.data;
+
+    // calc text texture size
+    int w = 0;
+    int h = 0;
+    for (int i = 32; i < 128; i++) {
+        if (FT_Load_Char(g_face, i, FT_LOAD_RENDER)) {
+            throw std::runtime_error{"failed to load charactor: " +
+                                     std::string{(char)i}};
+        }
+        auto const &bitmap = g_face->glyph->bitmap;
+        w += bitmap.width;
+        h = std::max(h, (int)bitmap.rows);
+    }
+    data.atlas_width = w;
+    data.atlas_height = h;
+    data.texture_id = 0;
+    atlas.pixels.assign(std::size_t(w) * h, 0);
+
+    // write font glyph bitmap to the atlas
+    int x = 0;
+    for (int i = 32; i < 128; i++) {
+        if (FT_Load_Char(g_face, i, FT_LOAD_RENDER))
+            continue;
+        auto glyph = g_face->glyph;
+        int glyph_w = glyph->bitmap.width;
+        int glyph_h = glyph->bitmap.rows;
+        for (int row = 0; row < glyph_h; row++) {
+            for (int col = 0; col < glyph_w; col++) {
+                atlas.pixels[row * w + x + col] =
+                    glyph->bitmap.buffer[row * glyph_w + col];
             }
-            glTextureSubImage2D(data.texture_id, 0, x, 0, glyph->bitmap.width,
-                                glyph->bitmap.rows, GL_RGBA, GL_UNSIGNED_BYTE,
-                                buf.data());
-
-            data.char_infos[i].advance_x = glyph->advance.x >> 6;
-            data.char_infos[i].width = glyph->bitmap.width;
-            data.char_infos[i].height = glyph->bitmap.rows;
-            data.char_infos[i].bearing_x = glyph->metrics.horiBearingX >> 6;
-            data.char_infos[i].bearing_y = glyph->metrics.horiBearingY >> 6;
-            data.char_infos[i].texture_x = x;
-            data.char_infos[i].texture_y = 0;
-
-            x += glyph->bitmap.width;
         }
-        g_font_data.insert(std::make_pair(key, data));
-        return g_font_data[key];
-    } else {
-        return found->second;
+
+        data.char_infos[i].advance_x = glyph->advance.x >> 6;
+        data.char_infos[i].width = glyph->bitmap.width;
+        data.char_infos[i].height = glyph->bitmap.rows;
+        data.char_infos[i].bearing_x = glyph->metrics.horiBearingX >> 6;
+        data.char_infos[i].bearing_y = glyph->metrics.horiBearingY >> 6;
+        data.char_infos[i].texture_x = x;
+        data.char_infos[i].texture_y = 0;
+
+        x += glyph->bitmap.width;
+    }
+    return atlas;
+}
+
+void pw::font::detail::upload(atlas_t &atlas) {
+    auto &data = atlas.data;
+    glCreateTextures(GL_TEXTURE_2D, 1, &data.texture_id);
+    glTextureParameteri(data.texture_id, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    glTextureParameteri(data.texture_id, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    if (data.atlas_width == 0 || data.atlas_height == 0)
+        return;
+    // coverage is stored once and read as white with alpha, a quarter of
+    // an RGBA atlas
+    glTextureStorage2D(data.texture_id, 1, GL_R8, data.atlas_width,
+                       data.atlas_height);
+    GLint const swizzle[] = {GL_ONE, GL_ONE, GL_ONE, GL_RED};
+    glTextureParameteriv(data.texture_id, GL_TEXTURE_SWIZZLE_RGBA, swizzle);
+    // rows of single byte texels are not 4-byte aligned
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+    glTextureSubImage2D(data.texture_id, 0, 0, 0, data.atlas_width,
+                        data.atlas_height, GL_RED, GL_UNSIGNED_BYTE,
+                        atlas.pixels.data());
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+    memory::track_texture(data.texture_id, atlas_bytes(data),
+                          memory::FONT_ATLAS, "font atlas");
+}
+
+pw::font::data_t const &pw::font::detail::insert(pw::font::key_t const &key,
+                                                 atlas_t &&atlas) {
+    auto texture_id = atlas.data.texture_id;
+    std::unique_lock lock{g_font_data_mutex};
+    auto [found, inserted] = g_font_data.emplace(key, std::move(atlas.data));
+    if (!inserted && found->second.texture_id == 0) {
+        // the atlas was evicted; its metrics are unchanged
+        found->second.texture_id = texture_id;
+    } else if (!inserted) {
+        // the texture was never bound, so the state tracker does not know it
+        glDeleteTextures(1, &texture_id);
+        memory::untrack_texture(texture_id);
     }
+    return found->second;
 }
@@ -0,0 +1,166 @@
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <protowork/gl.hpp>
+#include <protowork/memory.hpp>
+
+namespace pw = protowork;
+
+static constexpr pw::id_t UNKNOWN = ~pw::id_t{0};
+static constexpr std::size_t N_TEXTURE_UNITS = 16;
+
+// capabilities protowork toggles; others are not cached
+static constexpr std::array<GLenum, 3> g_capabilities = {
+    GL_DEPTH_TEST, GL_CULL_FACE, GL_BLEND};
+
+enum class capability_state_t { UNKNOWN, DISABLED, ENABLED };
+
+struct state_t {
+    pw::id_t program = UNKNOWN;
+    pw::id_t vertex_array = UNKNOWN;
+    pw::id_t array_buffer = UNKNOWN;
+    GLuint active_texture = UNKNOWN;
+    std::array<pw::id_t, N_TEXTURE_UNITS> textures;
+    std::array<capability_state_t, g_capabilities.size()> capabilities = {};
+    GLenum blend_src = GL_NONE;
+    GLenum blend_dst = GL_NONE;
+
+    state_t() { textures.fill(UNKNOWN); }
+};
+
+// only the GL thread writes the counters, so a relaxed load and store is
+// enough and avoids a locked instruction per state call
+struct counter_t {
+    std::atomic<std::uint64_t> value = 0;
+
+    void operator+=(std::uint64_t n) {
+        value.store(value.load(std::memory_order_relaxed) + n,
+                    std::memory_order_relaxed);
+    }
+    void operator++(int) { *this += 1; }
+};
+
+static state_t g_state;
+static struct {
+    counter_t issued;
+    counter_t elided;
+} g_stats;
+
+// returns true when the call has to be issued
+template <typename T> static bool update(T &cached, T value) {
+    if (cached == value) {
+        g_stats.elided++;
+        return false;
+    }
+    cached = value;
+    g_stats.issued++;
+    return true;
+}
+
+pw::gl::stats_t pw::gl::stats() {
+    return stats_t{g_stats.issued.value.load(std::memory_order_relaxed),
+                   g_stats.elided.value.load(std::memory_order_relaxed)};
+}
+
+void pw::gl::reset_stats() {
+    g_stats.issued.value.store(0, std::memory_order_relaxed);
+    g_stats.elided.value.store(0, std::memory_order_relaxed);
+}
+
+void pw::gl::invalidate() { g_state = state_t{}; }
+
+void pw::gl::use_program(id_t program) {
+    if (update(g_state.program, program))
+        glUseProgram(program);
+}
+
+void pw::gl::bind_vertex_array(id_t vertex_array) {
+    if (update(g_state.vertex_array, vertex_array))
+        glBindVertexArray(vertex_array);
+}
+
+void pw::gl::bind_array_buffer(id_t buffer) {
+    if (update(g_state.array_buffer, buffer))
+        glBindBuffer(GL_ARRAY_BUFFER, buffer);
+}
+
+void pw::gl::bind_texture_2d(GLuint unit, id_t texture) {
+    if (unit >= N_TEXTURE_UNITS) {
+        g_stats.issued += 2;
+        g_state.active_texture = UNKNOWN;
+        glActiveTexture(GL_TEXTURE0 + unit);
+        glBindTexture(GL_TEXTURE_2D, texture);
+        return;
+    }
+    if (g_state.textures[unit] == texture) {
+        g_stats.elided++;
+        return;
+    }
+    if (update(g_state.active_texture, unit))
+        glActiveTexture(GL_TEXTURE0 + unit);
+    update(g_state.textures[unit], texture);
+    glBindTexture(GL_TEXTURE_2D, texture);
+}
+
+void pw::gl::set_capability(GLenum capability, bool enabled) {
+    auto found = std::find(g_capabilities.begin(), g_capabilities.end(),
+                           capability);
+    if (found != g_capabilities.end()) {
+        auto value = enabled ? capability_state_t::ENABLED
+                             : capability_state_t::DISABLED;
+        auto &cached = g_state.capabilities[found - g_capabilities.begin()];
+        if (!update(cached, value))
+            return;
+    } else {
+        g_stats.issued++;
+    }
+    if (enabled)
+        glEnable(capability);
+    else
+        glDisable(capability);
+}
+
+void pw::gl::blend_func(GLenum src, GLenum dst) {
+    if (g_state.blend_src == src && g_state.blend_dst == dst) {
+        g_stats.elided++;
+        return;
+    }
+    g_state.blend_src = src;
+    g_state.blend_dst = dst;
+    g_stats.issued++;
+    glBlendFunc(src, dst);
+}
+
+void pw::gl::delete_program(id_t program) {
+    if (g_state.program == program)
+        g_state.program = UNKNOWN;
+    glDeleteProgram(program);
+}
+
+void pw::gl::delete_vertex_arrays(GLsizei n, id_t const *vertex_arrays) {
+    for (GLsizei i = 0; i < n; i++) {
+        if (g_state.vertex_array == vertex_arrays[i])
+            g_state.vertex_array = UNKNOWN;
+    }
+    glDeleteVertexArrays(n, vertex_arrays);
+}
+
+void pw::gl::delete_buffers(GLsizei n, id_t const *buffers) {
+    for (GLsizei i = 0; i < n; i++) {
+        if (g_state.array_buffer == buffers[i])
+            g_state.array_buffer = UNKNOWN;
+        pw::memory::untrack_buffer(buffers[i]);
+    }
+    glDeleteBuffers(n, buffers);
+}
+
+void pw::gl::delete_textures(GLsizei n, id_t const *textures) {
+    for (GLsizei i = 0; i < n; i++) {
+        for (auto &texture : g_state.textures) {
+            if (texture == textures[i])
+                texture = UNKNOWN;
+        }
+        pw::memory::untrack_texture(textures[i]);
+    }
+    glDeleteTextures(n, textures);
+}
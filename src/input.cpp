@@ -0,0 +1,68 @@
+#include <protowork/input.hpp>
+
+using namespace protowork;
+
+void input_t::begin_frame() {
+    using button_state_t = mouse_t::button_state_t;
+    for (auto &button : mouse.buttons) {
+        if (button == button_state_t::PUSHED)
+            button = button_state_t::PRESSED;
+    }
+    for (auto &key : keyboard.keys) {
+        if (key == button_state_t::PUSHED)
+            key = button_state_t::PRESSED;
+    }
+    mouse.scroll_x = mouse.scroll_y = 0.0;
+    events.clear();
+}
+
+void input_t::apply(event_t const &event) {
+    using button_state_t = mouse_t::button_state_t;
+    auto update = [&](button_state_t &state) {
+        if (event.action == event_t::action_t::RELEASE)
+            state = button_state_t::RELEASED;
+        else if (state == button_state_t::RELEASED)
+            state = button_state_t::PUSHED;
+    };
+
+    switch (event.kind) {
+    case event_t::kind_t::MOUSE_MOVE:
+        mouse.x = event.x;
+        mouse.y = event.y;
+        break;
+    case event_t::kind_t::MOUSE_BUTTON:
+        if (event.code >= 0 && event.code < mouse_t::N_BUTTONS)
+            update(mouse.buttons[event.code]);
+        break;
+    case event_t::kind_t::SCROLL:
+        mouse.scroll_x += event.x;
+        mouse.scroll_y += event.y;
+        break;
+    case event_t::kind_t::KEY:
+        if (event.code >= 0 && event.code < keyboard_t::N_KEYS)
+            update(keyboard.keys[event.code]);
+        break;
+    }
+    events.push_back(event);
+}
+
+bool detail::event_queue_t::push(event_t const &event) {
+    auto tail = m_tail.load(std::memory_order_relaxed);
+    if (tail - m_head.load(std::memory_order_acquire) == CAPACITY) {
+        m_dropped.store(m_dropped.load(std::memory_order_relaxed) + 1,
+                        std::memory_order_relaxed);
+        return false;
+    }
+    m_events[tail % CAPACITY] = event;
+    m_tail.store(tail + 1, std::memory_order_release);
+    return true;
+}
+
+bool detail::event_queue_t::pop(event_t &event) {
+    auto head = m_head.load(std::memory_order_relaxed);
+    if (head == m_tail.load(std::memory_order_acquire))
+        return false;
+    event = m_events[head % CAPACITY];
+    m_head.store(head + 1, std::memory_order_release);
+    return true;
+}
@@ -0,0 +1,151 @@
+#include <algorithm>
+#include <cmath>
+
+#include <GL/glew.h>
+
+#include <protowork/gl.hpp>
+#include <protowork/lighting.hpp>
+#include <protowork/memory.hpp>
+
+using namespace protowork;
+using namespace protowork::detail;
+
+light_clusters_t::~light_clusters_t() {
+    for (auto id : {m_light_buffer_id, m_range_buffer_id, m_index_buffer_id}) {
+        if (id != 0)
+            gl::delete_buffers(1, &id);
+    }
+}
+
+template <typename T>
+static void upload(id_t &buffer_id, std::vector<T> const &values) {
+    if (buffer_id == 0)
+        glCreateBuffers(1, &buffer_id);
+    // never empty, so that the binding is always valid; the previous
+    // storage is orphaned instead of waiting for draws still reading it
+    auto size = std::max<std::size_t>(values.size(), 1) * sizeof(T);
+    glNamedBufferData(buffer_id, size, nullptr, GL_STREAM_DRAW);
+    memory::track_buffer(buffer_id, size, memory::FRAME, "light clusters");
+    glNamedBufferSubData(buffer_id, 0, values.size() * sizeof(T),
+                         values.data());
+}
+
+void light_clusters_t::build(std::vector<world::point_light_t> const &lights,
+                             world::directional_light_t const &directional,
+                             matrix_t const &projection, matrix_t const &view,
+                             int screen_width, int screen_height) {
+    constexpr std::uint32_t N_CLUSTERS = TILES_X * TILES_Y * SLICES;
+
+    // near and far planes of a perspective projection
+    float near = projection[3][2] / (projection[2][2] - 1.f);
+    float far = projection[3][2] / (projection[2][2] + 1.f);
+    float log_ratio = std::log(far / near);
+
+    m_params.count = glm::uvec3{TILES_X, TILES_Y, SLICES};
+    m_params.depth_scale = SLICES / log_ratio;
+    m_params.depth_bias = -(SLICES * std::log(near)) / log_ratio;
+    m_params.screen_size =
+        glm::vec2{float(std::max(screen_width, 1)),
+                  float(std::max(screen_height, 1))};
+    m_params.light_direction =
+        glm::normalize(glm::mat3(view) * directional.direction);
+    m_params.light_color = directional.color;
+
+    auto slice_of = [&](float depth) {
+        auto slice = std::floor(std::log(depth) * m_params.depth_scale +
+                                m_params.depth_bias);
+        return static_cast<std::uint32_t>(
+            std::clamp(slice, 0.f, float(SLICES - 1)));
+    };
+    auto slice_depth = [&](std::uint32_t k) {
+        return near * std::pow(far / near, float(k) / SLICES);
+    };
+    auto tile_of = [](float ndc, std::uint32_t n_tiles) {
+        auto tile = std::floor((ndc + 1.f) * 0.5f * n_tiles);
+        return static_cast<std::uint32_t>(
+            std::clamp(tile, 0.f, float(n_tiles - 1)));
+    };
+    auto tile_ndc = [](std::uint32_t i, std::uint32_t n_tiles) {
+        return -1.f + 2.f * i / n_tiles;
+    };
+
+    m_lights.clear();
+    m_pairs.clear();
+    float scale_x = projection[0][0];
+    float scale_y = projection[1][1];
+    for (auto const &light : lights) {
+        auto center = view * glm::vec4{light.position, 1.f};
+        float depth = -center.z;
+        float r = light.radius;
+        if (r <= 0.f || depth + r < near || depth - r > far)
+            continue;
+
+        auto index = static_cast<std::uint32_t>(m_lights.size());
+        m_lights.push_back({glm::vec4{center.x, center.y, center.z, r},
+                            glm::vec4{light.color * light.intensity, 0.f}});
+
+        // clusters overlapping the bounds of the sphere; x / depth is
+        // extreme at the corners of the bounds
+        float d_min = std::max(depth - r, near);
+        float d_max = depth + r;
+        auto ndc_range = [&](float c, float scale, std::uint32_t n_tiles) {
+            float lo = std::min((c - r) / d_min, (c - r) / d_max) * scale;
+            float hi = std::max((c + r) / d_min, (c + r) / d_max) * scale;
+            return std::pair{tile_of(lo, n_tiles), tile_of(hi, n_tiles)};
+        };
+        auto [i0, i1] = ndc_range(center.x, scale_x, TILES_X);
+        auto [j0, j1] = ndc_range(center.y, scale_y, TILES_Y);
+        auto k0 = slice_of(d_min);
+        auto k1 = slice_of(std::min(d_max, far));
+
+        for (auto k = k0; k <= k1; k++) {
+            float dk0 = slice_depth(k);
+            float dk1 = slice_depth(k + 1);
+            float dz = std::max({dk0 - depth, 0.f, depth - dk1});
+            for (auto j = j0; j <= j1; j++) {
+                float a0 = tile_ndc(j, TILES_Y) / scale_y;
+                float a1 = tile_ndc(j + 1, TILES_Y) / scale_y;
+                float y0 = std::min(a0 * dk0, a0 * dk1);
+                float y1 = std::max(a1 * dk0, a1 * dk1);
+                float dy = std::max({y0 - center.y, 0.f, center.y - y1});
+                for (auto i = i0; i <= i1; i++) {
+                    float b0 = tile_ndc(i, TILES_X) / scale_x;
+                    float b1 = tile_ndc(i + 1, TILES_X) / scale_x;
+                    float x0 = std::min(b0 * dk0, b0 * dk1);
+                    float x1 = std::max(b1 * dk0, b1 * dk1);
+                    float dx = std::max({x0 - center.x, 0.f, center.x - x1});
+                    if (dx * dx + dy * dy + dz * dz > r * r)
+                        continue;
+                    std::uint64_t cluster = (k * TILES_Y + j) * TILES_X + i;
+                    m_pairs.push_back(cluster << 32 | index);
+                }
+            }
+        }
+    }
+
+    // counting sort of the pairs by cluster
+    m_ranges.assign(N_CLUSTERS, glm::uvec2{0});
+    for (auto pair : m_pairs)
+        m_ranges[pair >> 32].y++;
+    std::uint32_t offset = 0;
+    for (auto &range : m_ranges) {
+        range.x = offset;
+        offset += range.y;
+        range.y = 0;
+    }
+    m_indices.resize(m_pairs.size());
+    for (auto pair : m_pairs) {
+        auto &range = m_ranges[pair >> 32];
+        m_indices[range.x + range.y++] = static_cast<std::uint32_t>(pair);
+    }
+
+    upload(m_light_buffer_id, m_lights);
+    upload(m_range_buffer_id, m_ranges);
+    upload(m_index_buffer_id, m_indices);
+}
+
+void light_clusters_t::bind() const {
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, m_light_buffer_id);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 1, m_range_buffer_id);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 2, m_index_buffer_id);
+}
@@ -0,0 +1,212 @@
+#include <fstream>
+#include <future>
+#include <sstream>
+#include <stdexcept>
+
+#include <GL/glew.h>
+#include <GLFW/glfw3.h>
+
+#include <protowork/loader.hpp>
+#include <protowork/world/mesh_file.hpp>
+
+using namespace protowork;
+
+loader_t::loader_t(GLFWwindow *share, std::size_t worker_count) {
+    // the hints of the window are still set, so the context matches it
+    glfwWindowHint(GLFW_VISIBLE, GLFW_FALSE);
+    m_context = glfwCreateWindow(1, 1, "loader", nullptr, share);
+    glfwWindowHint(GLFW_VISIBLE, GLFW_TRUE);
+    if (m_context == nullptr)
+        throw std::runtime_error{"failed to create loader context"};
+
+    std::promise<void> initialized;
+    m_uploader = std::thread{[&] {
+        glfwMakeContextCurrent(m_context);
+        initialized.set_value();
+        run_uploader();
+    }};
+    initialized.get_future().wait();
+
+    for (std::size_t i = 0; i < std::max<std::size_t>(worker_count, 1); i++)
+        m_workers.emplace_back([this] { run_worker(); });
+}
+
+loader_t::~loader_t() {
+    {
+        std::lock_guard lock{m_mutex};
+        m_stop = true;
+    }
+    m_job_condition.notify_all();
+    m_upload_condition.notify_all();
+    for (auto &worker : m_workers)
+        worker.join();
+    m_uploader.join();
+
+    auto error = std::make_exception_ptr(
+        std::runtime_error{"loader was destroyed before loading finished"});
+    for (auto &job : m_jobs)
+        job.fail(error);
+    for (auto &job : m_uploads)
+        job.fail(error);
+    glfwDestroyWindow(m_context);
+}
+
+void loader_t::run_worker() {
+    while (true) {
+        job_t job;
+        {
+            std::unique_lock lock{m_mutex};
+            m_job_condition.wait(lock,
+                                 [&] { return m_stop || !m_jobs.empty(); });
+            if (m_stop)
+                return;
+            job = std::move(m_jobs.front());
+            m_jobs.pop_front();
+        }
+        try {
+            auto upload = job.decode();
+            std::lock_guard lock{m_mutex};
+            m_uploads.push_back({std::move(upload), std::move(job.fail)});
+        } catch (...) {
+            job.fail(std::current_exception());
+            continue;
+        }
+        m_upload_condition.notify_one();
+    }
+}
+
+void loader_t::run_uploader() {
+    std::deque<upload_job_t> uploads;
+    while (true) {
+        {
+            std::unique_lock lock{m_mutex};
+            // fences are polled while any is pending
+            if (m_fenced.empty())
+                m_upload_condition.wait(
+                    lock, [&] { return m_stop || !m_uploads.empty(); });
+            if (m_stop)
+                break;
+            uploads.swap(m_uploads);
+        }
+
+        for (auto &job : uploads) {
+            try {
+                auto complete = job.upload();
+                auto fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+                m_fenced.push_back(
+                    {fence, std::move(complete), std::move(job.fail)});
+            } catch (...) {
+                job.fail(std::current_exception());
+            }
+        }
+        if (!uploads.empty()) {
+            // submit the uploads, otherwise the fences may never signal
+            glFlush();
+            uploads.clear();
+        }
+
+        // fences signal in submission order
+        while (!m_fenced.empty()) {
+            auto &job = m_fenced.front();
+            auto status = glClientWaitSync(job.fence, 0, 1000000);
+            if (status == GL_TIMEOUT_EXPIRED)
+                break;
+            glDeleteSync(job.fence);
+            if (status == GL_WAIT_FAILED)
+                job.fail(std::make_exception_ptr(
+                    std::runtime_error{"failed to wait for an upload"}));
+            else
+                job.complete();
+            m_fenced.pop_front();
+        }
+    }
+
+    // whatever was uploaded is complete once the GPU finished it
+    glFinish();
+    for (auto &job : m_fenced) {
+        glDeleteSync(job.fence);
+        job.complete();
+    }
+    m_fenced.clear();
+    glfwMakeContextCurrent(nullptr);
+}
+
+template <typename T>
+resource_t<T> loader_t::submit(
+    std::function<std::function<std::shared_ptr<T>()>()> decode) {
+    resource_t<T> resource;
+    auto state = resource.m_state;
+    job_t job;
+    job.decode = [state, decode = std::move(decode)]() -> upload_t {
+        return [state, upload = decode()]() -> complete_t {
+            return [state, value = upload()] { state->set_value(value); };
+        };
+    };
+    job.fail = [state](std::exception_ptr error) { state->set_error(error); };
+    {
+        std::lock_guard lock{m_mutex};
+        m_jobs.push_back(std::move(job));
+    }
+    m_job_condition.notify_one();
+    return resource;
+}
+
+resource_t<world::model_t> loader_t::load_model(std::string path) {
+    return submit<world::model_t>([path = std::move(path)] {
+        auto source = world::mesh_file::read_source(path);
+        if (source.vertices.size() > world::mesh_file::MAX_CHUNK_VERTICES)
+            throw std::runtime_error{
+                path + ": too many vertices, convert it to .pwm"};
+
+        auto model = std::make_shared<world::model_t>();
+        model->vertices = std::move(source.vertices);
+        model->normals = source.normals.empty()
+                             ? world::mesh_file::compute_normals(
+                                   model->vertices, source.indices)
+                             : std::move(source.normals);
+        model->indices.assign(source.indices.begin(), source.indices.end());
+        return std::function<std::shared_ptr<world::model_t>()>{[model] {
+            model->upload();
+            return model;
+        }};
+    });
+}
+
+resource_t<font::data_t const> loader_t::load_font(int font_size) {
+    using result_t = std::shared_ptr<font::data_t const>;
+    return submit<font::data_t const>([font_size] {
+        font::key_t key{font_size};
+        auto atlas = std::make_shared<font::detail::atlas_t>(
+            font::detail::rasterize(key));
+        return std::function<result_t()>{[key, atlas] {
+            font::detail::upload(*atlas);
+            // atlases live until font::finalize(), so the handle does not
+            // own the data
+            return result_t{result_t{},
+                            &font::detail::insert(key, std::move(*atlas))};
+        }};
+    });
+}
+
+static std::string read_file(std::string const &path) {
+    std::ifstream in{path};
+    if (!in)
+        throw std::runtime_error{"failed to open " + path};
+    std::stringstream ss;
+    ss << in.rdbuf();
+    return ss.str();
+}
+
+resource_t<id_t const> loader_t::load_shader(std::string vertex_path,
+                                             std::string fragment_path) {
+    using result_t = std::shared_ptr<id_t const>;
+    return submit<id_t const>([vertex_path = std::move(vertex_path),
+                               fragment_path = std::move(fragment_path)] {
+        auto vertex_code = read_file(vertex_path);
+        auto fragment_code = read_file(fragment_path);
+        return std::function<result_t()>{[vertex_code, fragment_code] {
+            return std::make_shared<id_t const>(detail::load_shader_program(
+                vertex_code.c_str(), fragment_code.c_str()));
+        }};
+    });
+}
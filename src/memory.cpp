@@ -0,0 +1,135 @@
+#include <algorithm>
+#include <mutex>
+#include <unordered_map>
+
+#include <protowork/memory.hpp>
+
+namespace memory = protowork::memory;
+
+namespace {
+
+enum class kind_t : std::uint8_t { BUFFER, TEXTURE, HOST };
+
+struct object_key_t {
+    kind_t kind;
+    std::uintptr_t id;
+
+    bool operator==(object_key_t const &) const = default;
+};
+
+struct object_hash_t {
+    std::size_t operator()(object_key_t const &key) const {
+        return std::hash<std::uintptr_t>{}(key.id) ^
+               static_cast<std::size_t>(key.kind);
+    }
+};
+
+struct entry_t {
+    memory::category_t category;
+    char const *owner;
+    std::uint64_t bytes;
+};
+
+} // namespace
+
+static std::mutex g_mutex;
+static std::unordered_map<object_key_t, entry_t, object_hash_t> g_entries;
+static memory::stats_t g_stats;
+static std::array<std::uint64_t, memory::N_CATEGORIES> g_budgets = {};
+
+static memory::usage_t &usage_of(kind_t kind, memory::category_t category) {
+    return kind == kind_t::HOST ? g_stats.host[category]
+                                : g_stats.gpu[category];
+}
+
+static void track(object_key_t key, std::uint64_t bytes,
+                  memory::category_t category, char const *owner) {
+    std::lock_guard lock{g_mutex};
+    auto [found, inserted] =
+        g_entries.try_emplace(key, entry_t{category, owner, 0});
+    auto &entry = found->second;
+    if (!inserted) {
+        auto &old = usage_of(key.kind, entry.category);
+        old.bytes -= entry.bytes;
+        old.objects--;
+    }
+    auto &usage = usage_of(key.kind, category);
+    usage.bytes += bytes;
+    usage.objects++;
+    usage.peak = std::max(usage.peak, usage.bytes);
+    entry = entry_t{category, owner, bytes};
+}
+
+static void untrack(object_key_t key) {
+    std::lock_guard lock{g_mutex};
+    auto found = g_entries.find(key);
+    if (found == g_entries.end())
+        return;
+    auto &usage = usage_of(key.kind, found->second.category);
+    usage.bytes -= found->second.bytes;
+    usage.objects--;
+    g_entries.erase(found);
+}
+
+memory::stats_t memory::stats() {
+    std::lock_guard lock{g_mutex};
+    return g_stats;
+}
+
+void memory::reset_peaks() {
+    std::lock_guard lock{g_mutex};
+    for (auto *usages : {&g_stats.gpu, &g_stats.host}) {
+        for (auto &usage : *usages)
+            usage.peak = usage.bytes;
+    }
+}
+
+std::vector<memory::allocation_t> memory::allocations() {
+    std::lock_guard lock{g_mutex};
+    std::vector<allocation_t> result;
+    result.reserve(g_entries.size());
+    for (auto const &[key, entry] : g_entries) {
+        result.push_back(allocation_t{
+            key.kind == kind_t::HOST ? location_t::HOST : location_t::GPU,
+            entry.category, entry.owner, entry.bytes});
+    }
+    return result;
+}
+
+void memory::set_budget(category_t category, std::uint64_t bytes) {
+    std::lock_guard lock{g_mutex};
+    g_budgets[category] = bytes;
+}
+
+std::uint64_t memory::budget(category_t category) {
+    std::lock_guard lock{g_mutex};
+    return g_budgets[category];
+}
+
+void memory::track_buffer(id_t id, std::uint64_t bytes, category_t category,
+                          char const *owner) {
+    track(object_key_t{kind_t::BUFFER, id}, bytes, category, owner);
+}
+
+void memory::track_texture(id_t id, std::uint64_t bytes, category_t category,
+                           char const *owner) {
+    track(object_key_t{kind_t::TEXTURE, id}, bytes, category, owner);
+}
+
+void memory::untrack_buffer(id_t id) {
+    untrack(object_key_t{kind_t::BUFFER, id});
+}
+
+void memory::untrack_texture(id_t id) {
+    untrack(object_key_t{kind_t::TEXTURE, id});
+}
+
+void memory::track_host(void const *key, std::uint64_t bytes,
+                        category_t category, char const *owner) {
+    track(object_key_t{kind_t::HOST, reinterpret_cast<std::uintptr_t>(key)},
+          bytes, category, owner);
+}
+
+void memory::untrack_host(void const *key) {
+    untrack(object_key_t{kind_t::HOST, reinterpret_cast<std::uintptr_t>(key)});
+}
@@ -0,0 +1,280 @@
+#include <cstring>
+#include <fstream>
+#include <sstream>
+#include <stdexcept>
+
+#include <protowork/world/mesh_file.hpp>
+
+using namespace protowork;
+using namespace protowork::world;
+
+namespace {
+
+bool ends_with(std::string const &s, std::string const &suffix) {
+    return s.size() >= suffix.size() &&
+           s.compare(s.size() - suffix.size(), suffix.size(), suffix) == 0;
+}
+
+// 1-based, negative values count from the end
+std::uint32_t obj_index(long index, std::size_t count) {
+    if (index < 0)
+        index += count;
+    else
+        index -= 1;
+    if (index < 0 || static_cast<std::size_t>(index) >= count)
+        throw std::runtime_error{"OBJ: index out of range"};
+    return index;
+}
+
+// a corner "v", "v/vt", "v//vn" or "v/vt/vn" becomes a vertex of its own per
+// distinct (v, vn) pair; the writer merges duplicates anyway
+mesh_file::source_t load_obj(std::string const &path) {
+    std::ifstream in{path};
+    if (!in)
+        throw std::runtime_error{"failed to open " + path};
+
+    std::vector<pos_t> positions;
+    std::vector<glm::vec3> normals;
+    mesh_file::source_t mesh;
+    bool has_normals = true;
+    std::vector<std::uint32_t> face;
+
+    std::string line;
+    while (std::getline(in, line)) {
+        std::istringstream ss{line};
+        std::string tag;
+        ss >> tag;
+        if (tag == "v") {
+            pos_t p;
+            ss >> p.x >> p.y >> p.z;
+            positions.push_back(p);
+        } else if (tag == "vn") {
+            glm::vec3 n;
+            ss >> n.x >> n.y >> n.z;
+            normals.push_back(n);
+        } else if (tag == "f") {
+            face.clear();
+            std::string corner;
+            while (ss >> corner) {
+                long v = std::stol(corner);
+                mesh.vertices.push_back(
+                    positions[obj_index(v, positions.size())]);
+                auto first_slash = corner.find('/');
+                auto last_slash = corner.rfind('/');
+                if (first_slash != last_slash &&
+                    last_slash + 1 < corner.size()) {
+                    long n = std::stol(corner.substr(last_slash + 1));
+                    mesh.normals.push_back(
+                        normals[obj_index(n, normals.size())]);
+                } else {
+                    has_normals = false;
+                    mesh.normals.emplace_back(0.f);
+                }
+                face.push_back(mesh.vertices.size() - 1);
+            }
+            // fan triangulation
+            for (std::size_t i = 2; i < face.size(); i++) {
+                mesh.indices.push_back(face[0]);
+                mesh.indices.push_back(face[i - 1]);
+                mesh.indices.push_back(face[i]);
+            }
+        }
+    }
+    if (!has_normals)
+        mesh.normals.clear();
+    return mesh;
+}
+
+enum class ply_type_t {
+    INT8,
+    UINT8,
+    INT16,
+    UINT16,
+    INT32,
+    UINT32,
+    FLOAT32,
+    FLOAT64
+};
+
+ply_type_t ply_type(std::string const &name) {
+    if (name == "char" || name == "int8")
+        return ply_type_t::INT8;
+    if (name == "uchar" || name == "uint8")
+        return ply_type_t::UINT8;
+    if (name == "short" || name == "int16")
+        return ply_type_t::INT16;
+    if (name == "ushort" || name == "uint16")
+        return ply_type_t::UINT16;
+    if (name == "int" || name == "int32")
+        return ply_type_t::INT32;
+    if (name == "uint" || name == "uint32")
+        return ply_type_t::UINT32;
+    if (name == "float" || name == "float32")
+        return ply_type_t::FLOAT32;
+    if (name == "double" || name == "float64")
+        return ply_type_t::FLOAT64;
+    throw std::runtime_error{"PLY: unknown type " + name};
+}
+
+template <typename T> double read_binary(std::istream &in) {
+    T value;
+    in.read(reinterpret_cast<char *>(&value), sizeof(T));
+    return static_cast<double>(value);
+}
+
+double read_ply_value(std::istream &in, ply_type_t type, bool binary) {
+    if (!binary) {
+        double value;
+        in >> value;
+        return value;
+    }
+    switch (type) {
+    case ply_type_t::INT8:
+        return read_binary<std::int8_t>(in);
+    case ply_type_t::UINT8:
+        return read_binary<std::uint8_t>(in);
+    case ply_type_t::INT16:
+        return read_binary<std::int16_t>(in);
+    case ply_type_t::UINT16:
+        return read_binary<std::uint16_t>(in);
+    case ply_type_t::INT32:
+        return read_binary<std::int32_t>(in);
+    case ply_type_t::UINT32:
+        return read_binary<std::uint32_t>(in);
+    case ply_type_t::FLOAT32:
+        return read_binary<float>(in);
+    case ply_type_t::FLOAT64:
+        return read_binary<double>(in);
+    }
+    return 0.0;
+}
+
+struct ply_property_t {
+    std::string name;
+    ply_type_t type;
+    bool is_list = false;
+    ply_type_t count_type = ply_type_t::UINT8;
+};
+
+struct ply_element_t {
+    std::string name;
+    std::size_t count;
+    std::vector<ply_property_t> properties;
+};
+
+// ascii and binary_little_endian; vertex x/y/z[/nx/ny/nz] and face
+// vertex_indices (or vertex_index) lists, other properties are skipped
+mesh_file::source_t load_ply(std::string const &path) {
+    std::ifstream in{path, std::ios::binary};
+    if (!in)
+        throw std::runtime_error{"failed to open " + path};
+
+    std::string line;
+    std::getline(in, line);
+    if (line.rfind("ply", 0) != 0)
+        throw std::runtime_error{"PLY: bad magic in " + path};
+
+    bool binary = false;
+    std::vector<ply_element_t> elements;
+    while (std::getline(in, line)) {
+        if (!line.empty() && line.back() == '\r')
+            line.pop_back();
+        std::istringstream ss{line};
+        std::string tag;
+        ss >> tag;
+        if (tag == "format") {
+            std::string format;
+            ss >> format;
+            if (format == "binary_little_endian")
+                binary = true;
+            else if (format != "ascii")
+                throw std::runtime_error{"PLY: unsupported format " + format};
+        } else if (tag == "element") {
+            ply_element_t element;
+            ss >> element.name >> element.count;
+            elements.push_back(element);
+        } else if (tag == "property") {
+            if (elements.empty())
+                throw std::runtime_error{"PLY: property outside element"};
+            ply_property_t property;
+            std::string type;
+            ss >> type;
+            if (type == "list") {
+                std::string count_type, item_type;
+                ss >> count_type >> item_type;
+                property.is_list = true;
+                property.count_type = ply_type(count_type);
+                property.type = ply_type(item_type);
+            } else {
+                property.type = ply_type(type);
+            }
+            ss >> property.name;
+            elements.back().properties.push_back(property);
+        } else if (tag == "end_header") {
+            break;
+        }
+    }
+
+    mesh_file::source_t mesh;
+    bool has_normals = false;
+    std::vector<std::uint32_t> face;
+    for (auto const &element : elements) {
+        for (std::size_t e = 0; e < element.count; e++) {
+            pos_t p{0.f};
+            glm::vec3 n{0.f};
+            face.clear();
+            for (auto const &property : element.properties) {
+                if (property.is_list) {
+                    auto count = static_cast<std::size_t>(
+                        read_ply_value(in, property.count_type, binary));
+                    for (std::size_t i = 0; i < count; i++)
+                        face.push_back(static_cast<std::uint32_t>(
+                            read_ply_value(in, property.type, binary)));
+                    continue;
+                }
+                auto value = static_cast<float>(
+                    read_ply_value(in, property.type, binary));
+                auto const &name = property.name;
+                if (name == "x" || name == "y" || name == "z")
+                    p[name[0] - 'x'] = value;
+                else if (name == "nx" || name == "ny" || name == "nz")
+                    n[name[1] - 'x'] = value;
+            }
+            if (!in)
+                throw std::runtime_error{"PLY: truncated " + path};
+            if (element.name == "vertex") {
+                mesh.vertices.push_back(p);
+                mesh.normals.push_back(n);
+            } else if (element.name == "face") {
+                for (std::size_t i = 2; i < face.size(); i++) {
+                    mesh.indices.push_back(face[0]);
+                    mesh.indices.push_back(face[i - 1]);
+                    mesh.indices.push_back(face[i]);
+                }
+            }
+        }
+        if (element.name == "vertex") {
+            for (auto const &property : element.properties)
+                has_normals |= property.name == "nx";
+        }
+    }
+    if (!has_normals)
+        mesh.normals.clear();
+    return mesh;
+}
+
+} // namespace
+
+mesh_file::source_t mesh_file::read_source(std::string const &path) {
+    if (ends_with(path, ".obj"))
+        return load_obj(path);
+    if (ends_with(path, ".ply"))
+        return load_ply(path);
+    throw std::runtime_error{"unsupported mesh format: " + path};
+}
+
+void mesh_file::convert(std::string const &src, std::string const &dst,
+                        options_t options) {
+    auto mesh = read_source(src);
+    write(dst, mesh.vertices, mesh.normals, mesh.indices, options);
+}
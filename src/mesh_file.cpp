@@ -0,0 +1,429 @@
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <fstream>
+#include <stdexcept>
+#include <unordered_map>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <glm/gtc/matrix_transform.hpp>
+
+#include <protowork/gl.hpp>
+#include <protowork/memory.hpp>
+#include <protowork/world/mesh_file.hpp>
+
+using namespace protowork;
+using namespace protowork::world;
+
+static std::size_t align16(std::size_t n) {
+    return (n + 15) & ~std::size_t{15};
+}
+
+struct chunk_layout_t {
+    std::size_t positions;
+    std::size_t normals;
+    std::size_t indices;
+    std::size_t end;
+};
+
+// offsets relative to chunk_t::offset
+static chunk_layout_t layout_of(mesh_file::chunk_t const &chunk,
+                                bool quantized) {
+    std::size_t vertex_size = quantized ? 4 * sizeof(std::uint16_t)
+                                        : 3 * sizeof(float);
+    chunk_layout_t layout;
+    layout.positions = 0;
+    layout.normals = align16(chunk.vertex_count * vertex_size);
+    layout.indices =
+        align16(layout.normals + chunk.vertex_count * vertex_size);
+    layout.end = layout.indices + chunk.index_count * sizeof(index_t);
+    return layout;
+}
+
+std::vector<glm::vec3>
+mesh_file::compute_normals(std::vector<pos_t> const &vertices,
+                           std::vector<std::uint32_t> const &indices) {
+    std::vector<glm::vec3> normals(vertices.size(), glm::vec3(0.f));
+    for (std::size_t i = 0; i + 2 < indices.size(); i += 3) {
+        auto const &a = vertices[indices[i + 0]];
+        auto const &b = vertices[indices[i + 1]];
+        auto const &c = vertices[indices[i + 2]];
+        // area weighted
+        auto n = glm::cross(b - a, c - a);
+        for (std::size_t j = 0; j < 3; j++)
+            normals[indices[i + j]] += n;
+    }
+    for (auto &n : normals) {
+        auto length = glm::length(n);
+        n = length > 0.f ? n / length : glm::vec3{0.f, 1.f, 0.f};
+    }
+    return normals;
+}
+
+namespace {
+
+struct chunk_data_t {
+    std::vector<std::uint32_t> vertices; // global vertex of each local one
+    std::vector<index_t> indices;
+};
+
+struct vertex_key_hash_t {
+    std::size_t operator()(std::pair<pos_t, glm::vec3> const &v) const {
+        std::size_t h = 0;
+        for (int i = 0; i < 3; i++) {
+            h = h * 31 + std::hash<float>()(v.first[i]);
+            h = h * 31 + std::hash<float>()(v.second[i]);
+        }
+        return h;
+    }
+};
+
+} // namespace
+
+void mesh_file::write(std::string const &path,
+                      std::vector<pos_t> const &vertices,
+                      std::vector<glm::vec3> const &normals,
+                      std::vector<std::uint32_t> const &indices,
+                      options_t options) {
+    if (!normals.empty() && normals.size() != vertices.size())
+        throw std::runtime_error{"normal count differs from vertex count"};
+    if (indices.size() % 3 != 0)
+        throw std::runtime_error{"index count is not a multiple of 3"};
+    for (auto index : indices) {
+        if (index >= vertices.size())
+            throw std::runtime_error{"vertex index out of range"};
+    }
+
+    std::vector<glm::vec3> computed_normals;
+    if (normals.empty())
+        computed_normals = compute_normals(vertices, indices);
+    auto const &vertex_normals = normals.empty() ? computed_normals : normals;
+
+    // identical vertices are merged so that chunks hold fewer of them
+    std::vector<std::uint32_t> unique_of(vertices.size());
+    std::unordered_map<std::pair<pos_t, glm::vec3>, std::uint32_t,
+                       vertex_key_hash_t>
+        unique_ids;
+    for (std::uint32_t i = 0; i < vertices.size(); i++) {
+        auto key = std::make_pair(vertices[i], vertex_normals[i]);
+        auto [found, _] = unique_ids.emplace(key, i);
+        unique_of[i] = found->second;
+    }
+
+    // greedy split by triangle; local vertices are numbered by first use,
+    // which orders vertex fetches along the index stream
+    std::vector<chunk_data_t> chunks(1);
+    std::vector<std::uint32_t> local_of(vertices.size());
+    std::vector<std::uint32_t> chunk_of(vertices.size(), UINT32_MAX);
+    for (std::size_t i = 0; i < indices.size(); i += 3) {
+        std::size_t n_new = 0;
+        auto chunk_id = static_cast<std::uint32_t>(chunks.size() - 1);
+        for (std::size_t j = 0; j < 3; j++) {
+            if (chunk_of[unique_of[indices[i + j]]] != chunk_id)
+                n_new++;
+        }
+        if (chunks.back().vertices.size() + n_new > MAX_CHUNK_VERTICES) {
+            chunks.emplace_back();
+            chunk_id++;
+        }
+        auto &chunk = chunks.back();
+        for (std::size_t j = 0; j < 3; j++) {
+            auto v = unique_of[indices[i + j]];
+            if (chunk_of[v] != chunk_id) {
+                chunk_of[v] = chunk_id;
+                local_of[v] = chunk.vertices.size();
+                chunk.vertices.push_back(v);
+            }
+            chunk.indices.push_back(local_of[v]);
+        }
+    }
+    if (chunks.back().indices.empty())
+        chunks.pop_back();
+
+    header_t header{};
+    std::memcpy(header.magic, MAGIC, sizeof(MAGIC));
+    header.version = VERSION;
+    header.flags = options.quantize ? std::uint32_t{QUANTIZED} : 0u;
+    header.chunk_count = chunks.size();
+
+    std::vector<chunk_t> table(chunks.size());
+    aabb_t bounds;
+    auto offset = align16(sizeof(header_t) + sizeof(chunk_t) * table.size());
+    for (std::size_t c = 0; c < chunks.size(); c++) {
+        aabb_t chunk_bounds;
+        for (auto v : chunks[c].vertices)
+            chunk_bounds.extend(vertices[v]);
+        bounds.extend(chunk_bounds.min);
+        bounds.extend(chunk_bounds.max);
+
+        auto &entry = table[c];
+        entry.offset = offset;
+        entry.vertex_count = chunks[c].vertices.size();
+        entry.index_count = chunks[c].indices.size();
+        for (int i = 0; i < 3; i++) {
+            entry.min[i] = chunk_bounds.min[i];
+            entry.max[i] = chunk_bounds.max[i];
+        }
+        offset = align16(offset + layout_of(entry, options.quantize).end);
+    }
+    for (int i = 0; i < 3; i++) {
+        header.min[i] = bounds.empty() ? 0.f : bounds.min[i];
+        header.max[i] = bounds.empty() ? 0.f : bounds.max[i];
+    }
+
+    std::ofstream out{path, std::ios::binary | std::ios::trunc};
+    if (!out)
+        throw std::runtime_error{"failed to open " + path};
+    auto pad_to = [&](std::size_t position) {
+        static char const zeros[16] = {};
+        out.write(zeros, position - static_cast<std::size_t>(out.tellp()));
+    };
+    out.write(reinterpret_cast<char const *>(&header), sizeof(header));
+    out.write(reinterpret_cast<char const *>(table.data()),
+              sizeof(chunk_t) * table.size());
+
+    std::vector<char> buffer;
+    for (std::size_t c = 0; c < chunks.size(); c++) {
+        auto const &entry = table[c];
+        auto const &chunk = chunks[c];
+        auto layout = layout_of(entry, options.quantize);
+        buffer.assign(layout.end, 0);
+
+        auto *positions = buffer.data() + layout.positions;
+        auto *out_normals = buffer.data() + layout.normals;
+        for (std::size_t i = 0; i < chunk.vertices.size(); i++) {
+            auto const &p = vertices[chunk.vertices[i]];
+            auto const &n = vertex_normals[chunk.vertices[i]];
+            if (options.quantize) {
+                std::uint16_t qp[4] = {};
+                std::int16_t qn[4] = {};
+                for (int k = 0; k < 3; k++) {
+                    auto extent = entry.max[k] - entry.min[k];
+                    auto t = extent > 0.f ? (p[k] - entry.min[k]) / extent
+                                          : 0.f;
+                    qp[k] = static_cast<std::uint16_t>(
+                        std::lround(std::clamp(t, 0.f, 1.f) * 65535.f));
+                    qn[k] = static_cast<std::int16_t>(
+                        std::lround(std::clamp(n[k], -1.f, 1.f) * 32767.f));
+                }
+                std::memcpy(positions + i * sizeof(qp), qp, sizeof(qp));
+                std::memcpy(out_normals + i * sizeof(qn), qn, sizeof(qn));
+            } else {
+                std::memcpy(positions + i * sizeof(pos_t), &p, sizeof(pos_t));
+                std::memcpy(out_normals + i * sizeof(pos_t), &n,
+                            sizeof(pos_t));
+            }
+        }
+        std::memcpy(buffer.data() + layout.indices, chunk.indices.data(),
+                    chunk.indices.size() * sizeof(index_t));
+
+        pad_to(entry.offset);
+        out.write(buffer.data(), buffer.size());
+    }
+    if (!out)
+        throw std::runtime_error{"failed to write " + path};
+}
+
+mapped_model_t::mapped_model_t(std::string const &path,
+                               std::size_t upload_budget)
+    : m_upload_budget{upload_budget} {
+    int fd = open(path.c_str(), O_RDONLY);
+    if (fd < 0)
+        throw std::runtime_error{"failed to open " + path};
+    struct stat st;
+    if (fstat(fd, &st) != 0) {
+        close(fd);
+        throw std::runtime_error{"failed to stat " + path};
+    }
+    m_size = st.st_size;
+    m_data = m_size == 0 ? MAP_FAILED
+                         : mmap(nullptr, m_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (m_data == MAP_FAILED) {
+        m_data = nullptr;
+        throw std::runtime_error{"failed to map " + path};
+    }
+
+    auto fail = [&](char const *reason) {
+        munmap(m_data, m_size);
+        m_data = nullptr;
+        throw std::runtime_error{path + ": " + reason};
+    };
+    if (m_size < sizeof(mesh_file::header_t))
+        fail("truncated header");
+    m_header = static_cast<mesh_file::header_t const *>(m_data);
+    if (std::memcmp(m_header->magic, mesh_file::MAGIC,
+                    sizeof(mesh_file::MAGIC)) != 0)
+        fail("not a protowork mesh");
+    if (m_header->version != mesh_file::VERSION)
+        fail("unsupported version");
+    if (m_size < sizeof(mesh_file::header_t) +
+                     sizeof(mesh_file::chunk_t) * m_header->chunk_count)
+        fail("truncated chunk table");
+    m_chunks_table =
+        reinterpret_cast<mesh_file::chunk_t const *>(m_header + 1);
+
+    bool quantized = m_header->flags & mesh_file::QUANTIZED;
+    for (std::size_t c = 0; c < m_header->chunk_count; c++) {
+        auto const &chunk = m_chunks_table[c];
+        // the offset comes from the file, so the sum could overflow
+        if (chunk.offset % 16 != 0 || chunk.offset > m_size ||
+            layout_of(chunk, quantized).end > m_size - chunk.offset)
+            fail("chunk out of bounds");
+    }
+
+    // chunks are read once, front to back
+    madvise(m_data, m_size, MADV_SEQUENTIAL);
+    m_chunks.resize(m_header->chunk_count);
+}
+
+mapped_model_t::~mapped_model_t() {
+    for (auto const &chunk : m_chunks) {
+        detail::release_vertex_arrays({chunk.vertex_array_id});
+        detail::release_buffers({chunk.vertex_buffer_id,
+                                 chunk.normal_buffer_id,
+                                 chunk.index_buffer_id});
+    }
+    if (m_data)
+        munmap(m_data, m_size);
+}
+
+aabb_t mapped_model_t::compute_bounds() const {
+    if (m_header->chunk_count == 0)
+        return aabb_t{};
+    return aabb_t{pos_t{m_header->min[0], m_header->min[1], m_header->min[2]},
+                  pos_t{m_header->max[0], m_header->max[1], m_header->max[2]}};
+}
+
+void mapped_model_t::upload(std::size_t c) const {
+    auto const &chunk = m_chunks_table[c];
+    bool quantized = m_header->flags & mesh_file::QUANTIZED;
+    auto layout = layout_of(chunk, quantized);
+    auto const *base = static_cast<char const *>(m_data) + chunk.offset;
+    std::size_t vertex_size = quantized ? 4 * sizeof(std::uint16_t)
+                                        : 3 * sizeof(float);
+    auto &gpu = m_chunks[c];
+
+    // indices are checked here rather than when the file is opened, which
+    // would read all of it. a chunk referring to missing vertices is not
+    // drawn.
+    std::uint32_t index_count = chunk.index_count;
+    for (std::uint32_t i = 0; i < chunk.index_count; i++) {
+        index_t index;
+        std::memcpy(&index, base + layout.indices + i * sizeof(index_t),
+                    sizeof(index));
+        if (index >= chunk.vertex_count) {
+            index_count = 0;
+            break;
+        }
+    }
+    gpu.index_count = index_count;
+
+    glGenVertexArrays(1, &gpu.vertex_array_id);
+    glGenBuffers(1, &gpu.vertex_buffer_id);
+    glGenBuffers(1, &gpu.normal_buffer_id);
+    glGenBuffers(1, &gpu.index_buffer_id);
+
+    gl::bind_vertex_array(gpu.vertex_array_id);
+    gl::bind_array_buffer(gpu.vertex_buffer_id);
+    glBufferData(GL_ARRAY_BUFFER, chunk.vertex_count * vertex_size,
+                 base + layout.positions, GL_STATIC_DRAW);
+    glEnableVertexAttribArray(0);
+    if (quantized)
+        glVertexAttribPointer(0, 3, GL_UNSIGNED_SHORT, GL_TRUE, vertex_size,
+                              nullptr);
+    else
+        glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 0, nullptr);
+
+    gl::bind_array_buffer(gpu.normal_buffer_id);
+    glBufferData(GL_ARRAY_BUFFER, chunk.vertex_count * vertex_size,
+                 base + layout.normals, GL_STATIC_DRAW);
+    glEnableVertexAttribArray(1);
+    if (quantized)
+        glVertexAttribPointer(1, 3, GL_SHORT, GL_TRUE, vertex_size, nullptr);
+    else
+        glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, 0, nullptr);
+
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, gpu.index_buffer_id);
+    glBufferData(GL_ELEMENT_ARRAY_BUFFER, index_count * sizeof(index_t),
+                 base + layout.indices, GL_STATIC_DRAW);
+
+    memory::track_buffer(gpu.vertex_buffer_id, chunk.vertex_count * vertex_size,
+                         memory::GEOMETRY, "mapped model");
+    memory::track_buffer(gpu.normal_buffer_id, chunk.vertex_count * vertex_size,
+                         memory::GEOMETRY, "mapped model");
+    memory::track_buffer(gpu.index_buffer_id, index_count * sizeof(index_t),
+                         memory::GEOMETRY, "mapped model");
+    m_gpu_bytes +=
+        2 * chunk.vertex_count * vertex_size + index_count * sizeof(index_t);
+
+    // the driver copied the data; drop the pages so that files larger than
+    // memory do not keep the whole mapping resident
+    auto page = static_cast<std::size_t>(sysconf(_SC_PAGESIZE));
+    auto begin = reinterpret_cast<std::uintptr_t>(base);
+    auto end = begin + layout.end;
+    begin = (begin + page - 1) / page * page;
+    end = end / page * page;
+    if (begin < end)
+        madvise(reinterpret_cast<void *>(begin), end - begin, MADV_DONTNEED);
+}
+
+void mapped_model_t::evict() const {
+    std::size_t uploaded = m_n_uploaded.load(std::memory_order_relaxed);
+    for (std::size_t c = 0; c < uploaded; c++) {
+        auto &gpu = m_chunks[c];
+        gl::delete_vertex_arrays(1, &gpu.vertex_array_id);
+        id_t buffers[] = {gpu.vertex_buffer_id, gpu.normal_buffer_id,
+                          gpu.index_buffer_id};
+        gl::delete_buffers(3, buffers);
+        gpu = gpu_chunk_t{};
+    }
+    m_gpu_bytes = 0;
+    m_n_uploaded.store(0, std::memory_order_release);
+}
+
+void mapped_model_t::draw(matrix_t const &matrix, geometry_t const *,
+                          std::uint64_t) const {
+    // chunks stream in on the first draw of a frame only, so that every
+    // later draw of the frame, e.g. the shading pass after a depth
+    // pre-pass, draws the same chunks
+    bool first_draw = last_drawn() != current_frame();
+    mark_drawn();
+    std::size_t uploaded = m_n_uploaded.load(std::memory_order_relaxed);
+    std::size_t budget = m_upload_budget;
+    bool quantized = m_header->flags & mesh_file::QUANTIZED;
+
+    // at least one chunk per frame so that chunks larger than the budget
+    // still arrive
+    for (bool first = true; first_draw && uploaded < m_chunks.size();
+         first = false) {
+        auto const &chunk = m_chunks_table[uploaded];
+        auto size = layout_of(chunk, quantized).end;
+        if (!first && size > budget)
+            break;
+        upload(uploaded++);
+        budget -= std::min(size, budget);
+    }
+    m_n_uploaded.store(uploaded, std::memory_order_release);
+
+    for (std::size_t c = 0; c < uploaded; c++) {
+        auto const &chunk = m_chunks_table[c];
+        if (quantized) {
+            // normalized positions in [0, 1] span the chunk bounds
+            pos_t min{chunk.min[0], chunk.min[1], chunk.min[2]};
+            pos_t max{chunk.max[0], chunk.max[1], chunk.max[2]};
+            auto dequantize = glm::scale(glm::translate(matrix_t(1.f), min),
+                                         max - min);
+            set_model_matrix(matrix * dequantize, matrix);
+        } else if (c == 0) {
+            set_model_matrix(matrix);
+        }
+        gl::bind_vertex_array(m_chunks[c].vertex_array_id);
+        glDrawElements(GL_TRIANGLES, m_chunks[c].index_count, GL_UNSIGNED_SHORT,
+                       nullptr);
+    }
+}
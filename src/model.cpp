@@ -1,125 +1,517 @@
+#include <array>
+#include <cstring>
+#include <string>
+
 #include <GL/glew.h>
 #include <GLFW/glfw3.h>
 
 #include <protowork.hpp>
 #include <protowork/util.hpp>
+#include <protowork/gl.hpp>
+#include <protowork/memory.hpp>
 #include <protowork/world/model.hpp>
 
 using namespace protowork;
 using namespace protowork::world;
 
+// shader bodies; programs prepend the version and the #defines of their
+// features
 static const char *vertex_shader_code = R"(
-#version 430 core
-
 layout(location = 0) in vec3 i_VertexPosition_modelspace;
 layout(location = 1) in vec3 i_VertexNormal_modelspace;
 layout(location = 2) in vec2 i_VertexCoord;
+layout(location = 3) in vec3 i_VertexColor;
 
-out vec3 Normal_worldspace;
+out vec3 Position_viewspace;
+out vec3 Normal_viewspace;
 out vec2 Coord;
+out vec3 VertexColor;
+
+// depth of the pre-pass and the shading pass must match exactly
+invariant gl_Position;
 
 uniform mat4 u_ProjectionMatrix;
 uniform mat4 u_ViewMatrix;
 uniform mat4 u_ModelMatrix;
+uniform mat3 u_NormalMatrix;
 
 void main(){
-    gl_Position =  u_ProjectionMatrix * u_ViewMatrix * u_ModelMatrix * vec4(i_VertexPosition_modelspace, 1);
+    vec4 position_viewspace = u_ViewMatrix * u_ModelMatrix * vec4(i_VertexPosition_modelspace, 1);
+    gl_Position = u_ProjectionMatrix * position_viewspace;
 
-    Normal_worldspace = i_VertexNormal_modelspace; // (u_ModelMatrix * vec4(i_VertexNormal_modelspace, 1)).xyz;
+    Position_viewspace = position_viewspace.xyz;
+    Normal_viewspace = mat3(u_ViewMatrix) * (u_NormalMatrix * i_VertexNormal_modelspace);
+#ifdef HAS_TEXTURE
     Coord = i_VertexCoord;
+#endif
+#ifdef HAS_VERTEX_COLOR
+    VertexColor = i_VertexColor;
+#endif
 })";
 
 static const char *fragment_shader_code = R"(
-#version 430 core
-
-in vec3 Normal_worldspace;
+in vec3 Position_viewspace;
+in vec3 Normal_viewspace;
 in vec2 Coord;
+in vec3 VertexColor;
 
 out vec4 o_Color;
 
-void main()
-{
-    vec3 lightColor = vec3(1,1,1);
-    vec3 lightDir_worldspace = vec3(-1, -1, -1);
+uniform vec3 u_MaterialColor;
+uniform vec3 u_AmbientColor;
+uniform sampler2D u_Texture;
 
-    vec3 materialColor = vec3(1.0, 0.2, 0.2);
+#ifndef UNLIT
+struct light_t {
+    vec4 position_radius; // view space
+    vec4 color;
+};
 
-    vec3 n = normalize(Normal_worldspace);
-    vec3 l = normalize(lightDir_worldspace);
-    float cosTheta = clamp(dot(n, -l), 0, 1);
-    vec3 diffuseColor = materialColor * lightColor * cosTheta;
+layout(std430, binding = 0) readonly buffer Lights { light_t lights[]; };
+layout(std430, binding = 1) readonly buffer ClusterRanges { uvec2 cluster_ranges[]; };
+layout(std430, binding = 2) readonly buffer LightIndices { uint light_indices[]; };
 
-    vec3 ambientColor = vec3(0.2, 0.1, 0.1);
+uniform uvec3 u_ClusterCount;
+uniform float u_ClusterDepthScale;
+uniform float u_ClusterDepthBias;
+uniform vec2 u_ScreenSize;
+uniform vec3 u_LightDirection_viewspace;
+uniform vec3 u_LightColor;
 
+vec3 shade(vec3 n)
+{
+    float cosTheta = clamp(dot(n, -normalize(u_LightDirection_viewspace)), 0, 1);
+    vec3 light = u_LightColor * cosTheta;
+
+    // only the lights binned into this fragment's cluster
+    uvec2 tile = min(uvec2(gl_FragCoord.xy / u_ScreenSize * vec2(u_ClusterCount.xy)),
+                     u_ClusterCount.xy - 1);
+    float depth = max(-Position_viewspace.z, 1e-4);
+    uint slice = uint(clamp(floor(log(depth) * u_ClusterDepthScale + u_ClusterDepthBias),
+                            0, float(u_ClusterCount.z - 1)));
+    uvec2 range = cluster_ranges[(slice * u_ClusterCount.y + tile.y) * u_ClusterCount.x + tile.x];
+    for (uint i = range.x; i < range.x + range.y; i++) {
+        light_t l = lights[light_indices[i]];
+        vec3 to_light = l.position_radius.xyz - Position_viewspace;
+        float d = length(to_light);
+        float radius = l.position_radius.w;
+        // inverse square falloff windowed to zero at the radius
+        float window = clamp(1 - pow(d / radius, 4), 0, 1);
+        float attenuation = window * window / (d * d + 1);
+        light += l.color.rgb * attenuation * clamp(dot(n, to_light / max(d, 1e-4)), 0, 1);
+    }
+    return light;
+}
+#endif
+
+void main()
+{
+    vec3 materialColor = u_MaterialColor;
+#ifdef HAS_TEXTURE
+    materialColor *= texture(u_Texture, Coord).rgb;
+#endif
+#ifdef HAS_VERTEX_COLOR
+    materialColor *= VertexColor;
+#endif
+
+#ifdef UNLIT
+    o_Color = vec4(materialColor, 1);
+#else
     o_Color =
-        vec4(diffuseColor + ambientColor, 1);
+        vec4(materialColor * shade(normalize(Normal_viewspace)) + u_AmbientColor, 1);
+#endif
+})";
+
+// fragment shader of the depth pre-pass
+static const char *depth_fragment_shader_code = R"(
+void main()
+{
 })";
 
-static id_t g_shader_id;
-static id_t g_projection_matrix_id;
-static id_t g_view_matrix_id;
-static id_t g_model_matrix_id;
+namespace {
+
+// program of one feature combination and its uniform locations
+struct program_t {
+    id_t id = 0;
+    GLint projection_matrix;
+    GLint view_matrix;
+    GLint model_matrix;
+    GLint normal_matrix;
+    GLint material_color;
+    GLint ambient_color;
+    GLint cluster_count;
+    GLint cluster_depth_scale;
+    GLint cluster_depth_bias;
+    GLint screen_size;
+    GLint light_direction;
+    GLint light_color;
+    // frame whose uniforms were last set
+    std::uint64_t frame = 0;
+};
+
+// uniforms shared by every program within a frame
+struct frame_t {
+    matrix_t projection;
+    matrix_t view;
+    detail::cluster_params_t lighting;
+    std::uint64_t number = 0;
+};
+
+} // namespace
+
+// compiled on first use
+static std::array<program_t, detail::N_PERMUTATIONS> g_programs;
+static program_t g_depth_program;
+static program_t const *g_current_program = nullptr;
+static frame_t g_frame;
+
+static program_t compile_program(std::string const &vertex_shader,
+                                 std::string const &fragment_shader) {
+    program_t program;
+    program.id = detail::load_shader_program(vertex_shader.c_str(),
+                                             fragment_shader.c_str());
+    auto location = [&](char const *name) {
+        return glGetUniformLocation(program.id, name);
+    };
+    program.projection_matrix = location("u_ProjectionMatrix");
+    program.view_matrix = location("u_ViewMatrix");
+    program.model_matrix = location("u_ModelMatrix");
+    program.normal_matrix = location("u_NormalMatrix");
+    program.material_color = location("u_MaterialColor");
+    program.ambient_color = location("u_AmbientColor");
+    program.cluster_count = location("u_ClusterCount");
+    program.cluster_depth_scale = location("u_ClusterDepthScale");
+    program.cluster_depth_bias = location("u_ClusterDepthBias");
+    program.screen_size = location("u_ScreenSize");
+    program.light_direction = location("u_LightDirection_viewspace");
+    program.light_color = location("u_LightColor");
+
+    // the texture is always bound to unit 0
+    glProgramUniform1i(program.id, location("u_Texture"), 0);
+    return program;
+}
+
+static program_t compile_program(std::uint32_t features) {
+    std::string defines = "#version 430 core\n";
+    for (std::size_t i = 0; i < detail::N_FEATURES; i++) {
+        if (features & (1u << i))
+            defines += detail::FEATURE_DEFINES[i];
+    }
+    return compile_program(defines + vertex_shader_code,
+                           defines + fragment_shader_code);
+}
+
+// binds the program and sets the frame's uniforms unless it has them
+// already
+static program_t const &use_program(program_t &program) {
+    gl::use_program(program.id);
+    g_current_program = &program;
+
+    if (program.frame != g_frame.number) {
+        program.frame = g_frame.number;
+        auto const &lighting = g_frame.lighting;
+        glUniformMatrix4fv(program.projection_matrix, 1, GL_FALSE,
+                           &g_frame.projection[0][0]);
+        glUniformMatrix4fv(program.view_matrix, 1, GL_FALSE,
+                           &g_frame.view[0][0]);
+        glUniform3ui(program.cluster_count, lighting.count.x,
+                     lighting.count.y, lighting.count.z);
+        glUniform1f(program.cluster_depth_scale, lighting.depth_scale);
+        glUniform1f(program.cluster_depth_bias, lighting.depth_bias);
+        glUniform2f(program.screen_size, lighting.screen_size.x,
+                    lighting.screen_size.y);
+        glUniform3f(program.light_direction, lighting.light_direction.x,
+                    lighting.light_direction.y, lighting.light_direction.z);
+        glUniform3f(program.light_color, lighting.light_color.x,
+                    lighting.light_color.y, lighting.light_color.z);
+    }
+    return program;
+}
+
+static program_t const &use_program(std::uint32_t features) {
+    auto &program = g_programs[features];
+    if (program.id == 0)
+        program = compile_program(features);
+    return use_program(program);
+}
 
 void model_t::initialize() {
-    g_shader_id =
-        detail::load_shader_program(vertex_shader_code, fragment_shader_code);
+    // the default material is used by nearly every scene, so its program
+    // is compiled up front
+    g_programs[material_t{}.features] = compile_program(material_t{}.features);
+}
 
-    g_projection_matrix_id =
-        glGetUniformLocation(g_shader_id, "u_ProjectionMatrix");
-    g_view_matrix_id = glGetUniformLocation(g_shader_id, "u_ViewMatrix");
-    g_model_matrix_id = glGetUniformLocation(g_shader_id, "u_ModelMatrix");
+void model_t::finalize() {
+    for (auto &program : g_programs) {
+        if (program.id != 0)
+            gl::delete_program(program.id);
+        program = program_t{};
+    }
+    if (g_depth_program.id != 0)
+        gl::delete_program(g_depth_program.id);
+    g_depth_program = program_t{};
+    g_current_program = nullptr;
 }
 
-void model_t::finalize() { glDeleteProgram(g_shader_id); }
+void model_t::before_drawing(matrix_t const &projection_matrix,
+                             matrix_t const &view_matrix,
+                             detail::cluster_params_t const &lighting) {
+    gl::set_capability(GL_BLEND, false);
 
-void model_t::before_drawing(camera_t const &camera) {
-    glUseProgram(g_shader_id);
+    g_frame.projection = projection_matrix;
+    g_frame.view = view_matrix;
+    g_frame.lighting = lighting;
+    g_frame.number++;
+    g_current_program = nullptr;
+}
 
-    glm::mat4 projection_matrix = camera.projection();
-    glm::mat4 view_matrix = camera.view();
+void model_t::use_material(material_t const &material) {
+    // features index the programs, so unknown bits must not reach them
+    auto const &program = use_program(material.features & detail::FEATURE_MASK);
+    if (material.features & TEXTURE)
+        gl::bind_texture_2d(0, material.texture);
+    glUniform3f(program.material_color, material.color.x, material.color.y,
+                material.color.z);
+    glUniform3f(program.ambient_color, material.ambient.x, material.ambient.y,
+                material.ambient.z);
+}
 
-    glUniformMatrix4fv(g_projection_matrix_id, 1, GL_FALSE,
-                       &projection_matrix[0][0]);
-    glUniformMatrix4fv(g_view_matrix_id, 1, GL_FALSE, &view_matrix[0][0]);
+void model_t::use_depth_only() {
+    if (g_depth_program.id == 0) {
+        std::string version = "#version 430 core\n";
+        g_depth_program = compile_program(
+            version + vertex_shader_code, version + depth_fragment_shader_code);
+    }
+    use_program(g_depth_program);
 }
 
-model_t::model_t() {
-    glGenVertexArrays(1, &m_vertex_array_id);
-    glBindVertexArray(m_vertex_array_id);
+void model_t::set_model_matrix(matrix_t const &matrix) {
+    set_model_matrix(matrix, matrix);
+}
 
-    glGenBuffers(1, &m_vertex_buffer_id);
-    glGenBuffers(1, &m_normal_buffer_id);
-    glGenBuffers(1, &m_index_buffer_id);
+void model_t::set_model_matrix(matrix_t const &matrix,
+                               matrix_t const &normal_basis) {
+    // drawn outside the renderer without a material
+    if (!g_current_program)
+        use_material(material_t{});
+    glUniformMatrix4fv(g_current_program->model_matrix, 1, GL_FALSE,
+                       &matrix[0][0]);
+    // normals stay perpendicular to surfaces under non-uniform scale
+    auto normal_matrix =
+        glm::transpose(glm::inverse(glm::mat3(normal_basis)));
+    glUniformMatrix3fv(g_current_program->normal_matrix, 1, GL_FALSE,
+                       &normal_matrix[0][0]);
 }
 
+model_t::model_t() {}
+
 model_t::~model_t() {
-    glDeleteVertexArrays(1, &m_vertex_array_id);
-    glDeleteBuffers(1, &m_vertex_buffer_id);
-    glDeleteBuffers(1, &m_normal_buffer_id);
-    glDeleteBuffers(1, &m_index_buffer_id);
+    detail::release_vertex_arrays({m_vertex_array_id});
+    detail::release_buffers({m_vertex_buffer_id, m_normal_buffer_id,
+                             m_coord_buffer_id, m_color_buffer_id,
+                             m_index_buffer_id});
+    memory::untrack_host(this);
 }
 
-void model_t::draw() const {
-    glUniformMatrix4fv(g_model_matrix_id, 1, GL_FALSE, &model_matrix[0][0]);
+void model_t::set_geometry(geometry_t geometry) {
+    vertices = std::move(geometry.vertices);
+    normals = std::move(geometry.normals);
+    coords = std::move(geometry.coords);
+    colors = std::move(geometry.colors);
+    indices = std::move(geometry.indices);
+    invalidate();
+}
 
-    glEnableVertexAttribArray(0);
-    glBindBuffer(GL_ARRAY_BUFFER, m_vertex_buffer_id);
-    glBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(pos_t),
-                 vertices.data(), GL_STATIC_DRAW);
-    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 0, nullptr);
+// FNV-1a over 64-bit words, fast enough to run on every frame like the
+// upload it avoids
+template <typename T>
+static void hash_bytes(std::uint64_t &hash, std::vector<T> const &values) {
+    auto const *bytes = reinterpret_cast<unsigned char const *>(values.data());
+    auto size = values.size() * sizeof(T);
+    auto mix = [&hash](std::uint64_t word) {
+        hash = (hash ^ word) * 0x100000001b3;
+    };
+    std::size_t i = 0;
+    for (; i + 8 <= size; i += 8) {
+        std::uint64_t word;
+        std::memcpy(&word, bytes + i, 8);
+        mix(word);
+    }
+    for (; i < size; i++)
+        mix(bytes[i]);
+    mix(size);
+}
 
-    glEnableVertexAttribArray(1);
-    glBindBuffer(GL_ARRAY_BUFFER, m_normal_buffer_id);
-    glBufferData(GL_ARRAY_BUFFER, normals.size() * sizeof(pos_t),
-                 normals.data(), GL_STATIC_DRAW);
-    glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, 0, nullptr);
+std::uint64_t model_t::revision() const {
+    if (!m_explicit_revisions) {
+        // in-place edits are only noticed by looking at the data
+        std::uint64_t hash = 0xcbf29ce484222325;
+        hash_bytes(hash, vertices);
+        hash_bytes(hash, normals);
+        hash_bytes(hash, coords);
+        hash_bytes(hash, colors);
+        hash_bytes(hash, indices);
+        if (hash != m_hash) {
+            m_hash = hash;
+            m_revision++;
+        }
+        return m_revision;
+    }
+    std::array<std::size_t, 5> sizes = {vertices.size(), normals.size(),
+                                        coords.size(), colors.size(),
+                                        indices.size()};
+    // arrays filled or resized without invalidate()
+    if (sizes != m_sizes) {
+        m_sizes = sizes;
+        m_revision++;
+    }
+    return m_revision;
+}
 
-    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, m_index_buffer_id);
-    glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(index_t),
-                 indices.data(), GL_STATIC_DRAW);
+std::shared_ptr<geometry_t const> model_t::publish_geometry() const {
+    auto revision = this->revision();
+    if (m_published_revision != revision) {
+        m_published = std::make_shared<geometry_t const>(
+            geometry_t{vertices, normals, coords, colors, indices});
+        m_published_revision = revision;
+        memory::track_host(this,
+                           vertices.size() * sizeof(pos_t) +
+                               normals.size() * sizeof(glm::vec3) +
+                               coords.size() * sizeof(glm::vec2) +
+                               colors.size() * sizeof(glm::vec3) +
+                               indices.size() * sizeof(index_t),
+                           memory::GEOMETRY, "published geometry");
+    }
+    return m_published;
+}
 
-    glDrawElements(GL_TRIANGLES, indices.size(), GL_UNSIGNED_SHORT, nullptr);
+aabb_t model_t::compute_bounds() const {
+    aabb_t bounds;
+    for (auto const &vertex : vertices)
+        bounds.extend(vertex);
+    return bounds;
+}
 
-    glDisableVertexAttribArray(0);
-    glDisableVertexAttribArray(1);
-}
\ No newline at end of file
+bvh_t const &model_t::triangle_bvh() const {
+    auto revision = this->revision();
+    if (m_bvh_revision != revision) {
+        std::vector<aabb_t> boxes(indices.size() / 3);
+        for (std::size_t i = 0; i < boxes.size(); i++) {
+            for (std::size_t j = 0; j < 3; j++)
+                boxes[i].extend(vertices[indices[i * 3 + j]]);
+        }
+        m_bvh.build(boxes);
+        m_bvh_revision = revision;
+    }
+    return m_bvh;
+}
+
+void model_t::evict() const {
+    if (m_vertex_buffer_id == 0)
+        return;
+    gl::delete_vertex_arrays(1, &m_vertex_array_id);
+    id_t buffers[] = {m_vertex_buffer_id, m_normal_buffer_id,
+                      m_coord_buffer_id, m_color_buffer_id,
+                      m_index_buffer_id};
+    gl::delete_buffers(5, buffers);
+    m_vertex_array_id = m_vertex_buffer_id = m_normal_buffer_id =
+        m_coord_buffer_id = m_color_buffer_id = m_index_buffer_id = 0;
+    m_vertex_array_stale = true;
+    m_uploaded_revision = UINT64_MAX;
+    m_gpu_bytes = 0;
+}
+
+std::uint64_t model_t::current_frame() { return g_frame.number; }
+
+void model_t::mark_drawn() const { m_last_drawn = g_frame.number; }
+
+void model_t::draw() const { draw(model_matrix, nullptr, revision()); }
+
+void model_t::upload() const { upload(nullptr, revision()); }
+
+void model_t::upload(geometry_t const *geometry,
+                     std::uint64_t revision) const {
+    if (m_uploaded_revision == revision)
+        return;
+    if (m_vertex_buffer_id == 0) {
+        glCreateBuffers(1, &m_vertex_buffer_id);
+        glCreateBuffers(1, &m_normal_buffer_id);
+        glCreateBuffers(1, &m_coord_buffer_id);
+        glCreateBuffers(1, &m_color_buffer_id);
+        glCreateBuffers(1, &m_index_buffer_id);
+    }
+
+    // without a published copy, geometry is read from this model directly
+    auto const &src_vertices = geometry ? geometry->vertices : vertices;
+    auto const &src_normals = geometry ? geometry->normals : normals;
+    auto const &src_coords = geometry ? geometry->coords : coords;
+    auto const &src_colors = geometry ? geometry->colors : colors;
+    auto const &src_indices = geometry ? geometry->indices : indices;
+
+    m_gpu_bytes = 0;
+    auto store = [&](id_t buffer_id, auto const &values) {
+        auto size = values.size() * sizeof(values[0]);
+        glNamedBufferData(buffer_id, size, values.data(), GL_STATIC_DRAW);
+        memory::track_buffer(buffer_id, size, memory::GEOMETRY, "model");
+        m_gpu_bytes += size;
+    };
+    store(m_vertex_buffer_id, src_vertices);
+    store(m_normal_buffer_id, src_normals);
+    store(m_coord_buffer_id, src_coords);
+    store(m_color_buffer_id, src_colors);
+    store(m_index_buffer_id, src_indices);
+    m_index_count = src_indices.size();
+    m_uploaded_revision = revision;
+
+    // attributes without data keep their constant value instead of reading
+    // out of range
+    bool has_coords = !src_coords.empty();
+    bool has_colors = !src_colors.empty();
+    if (has_coords != m_has_coords || has_colors != m_has_colors) {
+        m_has_coords = has_coords;
+        m_has_colors = has_colors;
+        m_vertex_array_stale = true;
+    }
+}
+
+void model_t::draw(matrix_t const &matrix, geometry_t const *geometry,
+                   std::uint64_t revision) const {
+    mark_drawn();
+    upload(geometry, revision);
+    if (m_vertex_array_stale) {
+        // attribute layout and index buffer binding are recorded in the
+        // vertex array once, so drawing only has to bind it. vertex arrays
+        // are not shared between contexts, so it is created here.
+        if (m_vertex_array_id == 0)
+            glGenVertexArrays(1, &m_vertex_array_id);
+        m_vertex_array_stale = false;
+
+        gl::bind_vertex_array(m_vertex_array_id);
+        glEnableVertexAttribArray(0);
+        gl::bind_array_buffer(m_vertex_buffer_id);
+        glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 0, nullptr);
+        glEnableVertexAttribArray(1);
+        gl::bind_array_buffer(m_normal_buffer_id);
+        glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, 0, nullptr);
+        if (m_has_coords) {
+            glEnableVertexAttribArray(2);
+            gl::bind_array_buffer(m_coord_buffer_id);
+            glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, 0, nullptr);
+        } else {
+            glDisableVertexAttribArray(2);
+        }
+        if (m_has_colors) {
+            glEnableVertexAttribArray(3);
+            gl::bind_array_buffer(m_color_buffer_id);
+            glVertexAttribPointer(3, 3, GL_FLOAT, GL_FALSE, 0, nullptr);
+        } else {
+            glDisableVertexAttribArray(3);
+            glVertexAttrib3f(3, 1.f, 1.f, 1.f);
+        }
+        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, m_index_buffer_id);
+    }
+    gl::bind_vertex_array(m_vertex_array_id);
+
+    set_model_matrix(matrix);
+    glDrawElements(GL_TRIANGLES, m_index_count, GL_UNSIGNED_SHORT, nullptr);
+}
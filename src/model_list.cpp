@@ -0,0 +1,231 @@
+#include <algorithm>
+#include <stdexcept>
+
+#include <protowork/parallel.hpp>
+#include <protowork/world/model_list.hpp>
+
+using namespace protowork;
+using namespace protowork::world;
+
+handle_t model_list_t::push_back(std::shared_ptr<model_t> model) {
+    auto const &transform = model->model_matrix;
+    return emplace(std::move(model), transform, true);
+}
+
+handle_t model_list_t::insert(std::shared_ptr<model_t> model,
+                              matrix_t const &transform) {
+    return emplace(std::move(model), transform, false);
+}
+
+handle_t model_list_t::emplace(std::shared_ptr<model_t> model,
+                               matrix_t const &transform, bool follows_model) {
+    auto handle = m_slots.insert(m_owners.size());
+    m_handles.push_back(handle);
+    m_local_transforms.push_back(transform);
+    m_transforms.push_back(transform);
+    m_parents.push_back(handle_t{});
+    m_parent_indices.push_back(NO_PARENT);
+    m_dirty.push_back(false);
+    // models are often filled after being added, so bounds are computed by
+    // the next sync()
+    m_bounds.push_back(aabb_t{});
+    m_revisions.push_back(UINT64_MAX);
+    m_models.push_back(model.get());
+    m_follows_model.push_back(follows_model);
+    m_owners.push_back(std::move(model));
+
+    // a root appended after deeper elements breaks the depth order
+    if (m_n_parented != 0)
+        m_order_stale = true;
+    m_version++;
+    return handle;
+}
+
+void model_list_t::erase(handle_t handle) {
+    auto dense = m_slots.erase(handle);
+    if (m_parents[dense] != handle_t{})
+        m_n_parented--;
+
+    auto last = m_owners.size() - 1;
+    std::apply(
+        [&](auto &...array) {
+            if (dense != last)
+                ((array[dense] = std::move(array[last])), ...);
+            (array.pop_back(), ...);
+        },
+        arrays());
+    if (dense != last)
+        m_slots.relocate(m_handles[dense], dense);
+
+    // children of the removed element and the moved element are fixed up
+    // when the order is rebuilt
+    if (m_n_parented != 0)
+        m_order_stale = true;
+    m_version++;
+}
+
+void model_list_t::clear() {
+    m_slots.clear();
+    std::apply([](auto &...array) { (array.clear(), ...); }, arrays());
+    m_depth_offsets.clear();
+    m_n_parented = 0;
+    m_order_stale = false;
+    m_version++;
+}
+
+void model_list_t::set_transform(handle_t handle, matrix_t const &transform) {
+    auto dense = m_slots.dense(handle);
+    m_local_transforms[dense] = transform;
+    m_follows_model[dense] = false;
+    m_dirty[dense] = true;
+}
+
+void model_list_t::set_parent(handle_t child, handle_t parent) {
+    auto dense = m_slots.dense(child);
+    m_slots.dense(parent); // throws for an invalid parent
+    for (auto ancestor = parent; m_slots.contains(ancestor);
+         ancestor = m_parents[m_slots.dense(ancestor)]) {
+        if (ancestor == child)
+            throw std::invalid_argument{"parenting would create a cycle"};
+    }
+    if (m_parents[dense] == handle_t{})
+        m_n_parented++;
+    m_parents[dense] = parent;
+    m_dirty[dense] = true;
+    m_order_stale = true;
+}
+
+void model_list_t::clear_parent(handle_t child) {
+    auto dense = m_slots.dense(child);
+    if (m_parents[dense] == handle_t{})
+        return;
+    m_n_parented--;
+    m_parents[dense] = handle_t{};
+    m_dirty[dense] = true;
+    m_order_stale = true;
+}
+
+void model_list_t::sync() {
+    for (std::size_t i = 0; i < m_models.size(); i++) {
+        auto const *model = m_models[i];
+        if (m_follows_model[i] &&
+            m_local_transforms[i] != model->model_matrix) {
+            m_local_transforms[i] = model->model_matrix;
+            m_dirty[i] = true;
+        }
+        if (auto revision = model->revision(); m_revisions[i] != revision) {
+            m_bounds[i] = model->compute_bounds();
+            m_revisions[i] = revision;
+            m_version++;
+        }
+    }
+
+    if (m_order_stale)
+        sort_by_depth();
+
+    // elements of one depth only read transforms of shallower elements,
+    // so each depth is propagated in parallel when it is wide enough
+    auto propagate = [this](std::size_t begin, std::size_t end, std::size_t) {
+        propagate_transforms(begin, end);
+    };
+    if (m_n_parented == 0) {
+        detail::parallel_for(size(), 4096, propagate);
+    } else {
+        for (std::size_t d = 0; d + 1 < m_depth_offsets.size(); d++) {
+            auto begin = m_depth_offsets[d];
+            auto end = m_depth_offsets[d + 1];
+            detail::parallel_for(end - begin, 4096,
+                                 [&](std::size_t b, std::size_t e,
+                                     std::size_t) {
+                                     propagate_transforms(begin + b,
+                                                          begin + e);
+                                 });
+        }
+    }
+    if (std::find(m_dirty.begin(), m_dirty.end(), true) != m_dirty.end()) {
+        m_version++;
+        std::fill(m_dirty.begin(), m_dirty.end(), false);
+    }
+}
+
+void model_list_t::propagate_transforms(std::size_t begin, std::size_t end) {
+    for (auto i = begin; i < end; i++) {
+        auto parent = m_parent_indices[i];
+        if (parent == NO_PARENT) {
+            if (m_dirty[i])
+                m_transforms[i] = m_local_transforms[i];
+        } else if (m_dirty[i] || m_dirty[parent]) {
+            // marking the child lets the change reach its own children
+            m_dirty[i] = true;
+            m_transforms[i] = m_transforms[parent] * m_local_transforms[i];
+        }
+    }
+}
+
+void model_list_t::sort_by_depth() {
+    auto n = size();
+
+    // parents of removed elements are dropped, their children become roots
+    for (auto &parent : m_parents) {
+        if (parent != handle_t{} && !m_slots.contains(parent)) {
+            parent = handle_t{};
+            m_n_parented--;
+        }
+    }
+
+    std::vector<std::uint32_t> depths(n, UINT32_MAX);
+    std::vector<std::uint32_t> chain;
+    for (std::size_t i = 0; i < n; i++) {
+        auto current = static_cast<std::uint32_t>(i);
+        while (depths[current] == UINT32_MAX) {
+            chain.push_back(current);
+            if (m_parents[current] == handle_t{})
+                break;
+            current = m_slots.dense(m_parents[current]);
+        }
+        auto depth = depths[current] == UINT32_MAX ? 0 : depths[current] + 1;
+        while (!chain.empty()) {
+            depths[chain.back()] = depth++;
+            chain.pop_back();
+        }
+    }
+
+    // stable counting sort of the elements by depth
+    std::uint32_t max_depth = 0;
+    for (auto depth : depths)
+        max_depth = std::max(max_depth, depth);
+    m_depth_offsets.assign(n == 0 ? 1 : max_depth + 2, 0);
+    for (auto depth : depths)
+        m_depth_offsets[depth + 1]++;
+    for (std::size_t d = 1; d < m_depth_offsets.size(); d++)
+        m_depth_offsets[d] += m_depth_offsets[d - 1];
+
+    std::vector<std::size_t> order(n);
+    auto next = m_depth_offsets;
+    for (std::size_t i = 0; i < n; i++)
+        order[next[depths[i]]++] = i;
+
+    std::apply(
+        [&](auto &...array) {
+            auto permute = [&](auto &values) {
+                std::remove_reference_t<decltype(values)> sorted;
+                sorted.reserve(n);
+                for (auto i : order)
+                    sorted.push_back(std::move(values[i]));
+                values.swap(sorted);
+            };
+            (permute(array), ...);
+        },
+        arrays());
+
+    for (std::size_t i = 0; i < n; i++) {
+        m_slots.relocate(m_handles[i], i);
+    }
+    for (std::size_t i = 0; i < n; i++) {
+        m_parent_indices[i] = m_parents[i] == handle_t{}
+                                  ? NO_PARENT
+                                  : m_slots.dense(m_parents[i]);
+    }
+    std::fill(m_dirty.begin(), m_dirty.end(), true);
+    m_order_stale = false;
+}
@@ -0,0 +1,300 @@
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <stdexcept>
+#include <string>
+
+#include <GL/glew.h>
+
+#include <protowork/gl.hpp>
+#include <protowork/memory.hpp>
+#include <protowork/occlusion.hpp>
+
+using namespace protowork;
+using namespace protowork::detail;
+
+void depth_pyramid_t::assign(int width, int height, int block,
+                             std::vector<float> &depth,
+                             matrix_t const &view_projection) {
+    m_pixel_width = width;
+    m_pixel_height = height;
+    m_block = block;
+    m_view_projection = view_projection;
+
+    if (m_levels.empty())
+        m_levels.emplace_back();
+    auto &base = m_levels[0];
+    base.width = (width + block - 1) / block;
+    base.height = (height + block - 1) / block;
+    base.depth.swap(depth);
+
+    std::size_t n = 1;
+    while (m_levels[n - 1].width > 1 || m_levels[n - 1].height > 1) {
+        if (m_levels.size() == n)
+            m_levels.emplace_back();
+        auto const &fine = m_levels[n - 1];
+        auto &coarse = m_levels[n];
+        coarse.width = (fine.width + 1) / 2;
+        coarse.height = (fine.height + 1) / 2;
+        coarse.depth.resize(std::size_t(coarse.width) * coarse.height);
+        for (int y = 0; y < coarse.height; y++) {
+            int y0 = y * 2;
+            int y1 = std::min(y0 + 1, fine.height - 1);
+            for (int x = 0; x < coarse.width; x++) {
+                int x0 = x * 2;
+                int x1 = std::min(x0 + 1, fine.width - 1);
+                auto at = [&](int i, int j) {
+                    return fine.depth[std::size_t(j) * fine.width + i];
+                };
+                coarse.depth[std::size_t(y) * coarse.width + x] =
+                    std::max({at(x0, y0), at(x1, y0), at(x0, y1), at(x1, y1)});
+            }
+        }
+        n++;
+    }
+    m_levels.resize(n);
+}
+
+float depth_pyramid_t::farthest(int level, int x0, int y0, int x1,
+                                int y1) const {
+    auto const &l = m_levels[level];
+    x0 = std::min(x0, l.width - 1), x1 = std::min(x1, l.width - 1);
+    y0 = std::min(y0, l.height - 1), y1 = std::min(y1, l.height - 1);
+    float depth = 0.f;
+    for (int y = y0; y <= y1; y++) {
+        for (int x = x0; x <= x1; x++)
+            depth = std::max(depth, l.depth[std::size_t(y) * l.width + x]);
+    }
+    return depth;
+}
+
+bool depth_pyramid_t::is_occluded(aabb_t const &box) const {
+    if (empty() || box.empty())
+        return false;
+
+    glm::vec2 lo{std::numeric_limits<float>::max()};
+    glm::vec2 hi{-std::numeric_limits<float>::max()};
+    float nearest = std::numeric_limits<float>::max();
+    for (int i = 0; i < 8; i++) {
+        glm::vec4 corner{i & 1 ? box.max.x : box.min.x,
+                         i & 2 ? box.max.y : box.min.y,
+                         i & 4 ? box.max.z : box.min.z, 1.f};
+        auto clip = m_view_projection * corner;
+        if (clip.w <= 1e-5f)
+            return false;
+        glm::vec3 ndc = glm::vec3{clip} / clip.w;
+        lo = glm::min(lo, glm::vec2{ndc});
+        hi = glm::max(hi, glm::vec2{ndc});
+        nearest = std::min(nearest, ndc.z * 0.5f + 0.5f);
+    }
+    return is_behind(lo, hi, nearest);
+}
+
+bool depth_pyramid_t::is_occluded(pos_t const &anchor, glm::vec2 lo,
+                                  glm::vec2 hi) const {
+    if (empty())
+        return false;
+    auto clip = m_view_projection * glm::vec4{anchor, 1.f};
+    if (clip.w <= 1e-5f)
+        return false;
+    glm::vec3 ndc = glm::vec3{clip} / clip.w;
+    return is_behind(glm::vec2{ndc} + lo, glm::vec2{ndc} + hi,
+                     ndc.z * 0.5f + 0.5f);
+}
+
+bool depth_pyramid_t::is_behind(glm::vec2 lo, glm::vec2 hi,
+                                float nearest) const {
+    if (lo.x < -1.f || lo.y < -1.f || hi.x > 1.f || hi.y > 1.f)
+        return false;
+
+    // level 0 texels under the rectangle, then the finest level at which
+    // they fit into 4 x 4 texels
+    auto texel = [&](float ndc, int pixels) {
+        return static_cast<int>((ndc * 0.5f + 0.5f) * pixels / m_block);
+    };
+    int x0 = texel(lo.x, m_pixel_width), x1 = texel(hi.x, m_pixel_width);
+    int y0 = texel(lo.y, m_pixel_height), y1 = texel(hi.y, m_pixel_height);
+    int level = 0;
+    while (std::max(x1 - x0, y1 - y0) > 3 &&
+           level + 1 < static_cast<int>(m_levels.size())) {
+        x0 >>= 1, x1 >>= 1, y0 >>= 1, y1 >>= 1;
+        level++;
+    }
+    return nearest > farthest(level, x0, y0, x1, y1);
+}
+
+// one invocation per level 0 texel, keeping the farthest depth of its block
+static std::string const compute_shader_code = R"(
+#version 430 core
+
+layout(local_size_x = 8, local_size_y = 8) in;
+
+uniform sampler2D u_Depth;
+uniform ivec2 u_Size;
+uniform ivec2 u_Texels;
+
+layout(std430, binding = 3) writeonly buffer Reduced { float reduced[]; };
+
+void main() {
+    ivec2 texel = ivec2(gl_GlobalInvocationID.xy);
+    if (any(greaterThanEqual(texel, u_Texels)))
+        return;
+    ivec2 begin = texel * BLOCK;
+    ivec2 end = min(begin + BLOCK, u_Size);
+    float depth = 0;
+    for (int y = begin.y; y < end.y; y++) {
+        for (int x = begin.x; x < end.x; x++)
+            depth = max(depth, texelFetch(u_Depth, ivec2(x, y), 0).r);
+    }
+    reduced[texel.y * u_Texels.x + texel.x] = depth;
+})";
+
+static id_t load_compute_program(std::string const &source) {
+    auto const *code = source.c_str();
+    id_t shader_id = glCreateShader(GL_COMPUTE_SHADER);
+    glShaderSource(shader_id, 1, &code, nullptr);
+    glCompileShader(shader_id);
+
+    GLint result = GL_FALSE;
+    glGetShaderiv(shader_id, GL_COMPILE_STATUS, &result);
+    if (result != GL_TRUE) {
+        int length = 0;
+        glGetShaderiv(shader_id, GL_INFO_LOG_LENGTH, &length);
+        std::string msg(std::max(length, 1), '\0');
+        glGetShaderInfoLog(shader_id, length, nullptr, msg.data());
+        glDeleteShader(shader_id);
+        throw std::runtime_error{msg};
+    }
+
+    id_t program_id = glCreateProgram();
+    glAttachShader(program_id, shader_id);
+    glLinkProgram(program_id);
+    glDetachShader(program_id, shader_id);
+    glDeleteShader(shader_id);
+
+    glGetProgramiv(program_id, GL_LINK_STATUS, &result);
+    if (result != GL_TRUE) {
+        int length = 0;
+        glGetProgramiv(program_id, GL_INFO_LOG_LENGTH, &length);
+        std::string msg(std::max(length, 1), '\0');
+        glGetProgramInfoLog(program_id, length, nullptr, msg.data());
+        glDeleteProgram(program_id);
+        throw std::runtime_error{msg};
+    }
+    return program_id;
+}
+
+bool hi_z_t::is_supported() {
+    GLint depth_bits = 0, stencil_bits = 0;
+    glGetNamedFramebufferAttachmentParameteriv(
+        0, GL_DEPTH, GL_FRAMEBUFFER_ATTACHMENT_DEPTH_SIZE, &depth_bits);
+    glGetNamedFramebufferAttachmentParameteriv(
+        0, GL_STENCIL, GL_FRAMEBUFFER_ATTACHMENT_STENCIL_SIZE, &stencil_bits);
+    return depth_bits == 24 && stencil_bits == 8;
+}
+
+hi_z_t::hi_z_t() {
+    auto source = compute_shader_code;
+    source.insert(source.find("layout"),
+                  "#define BLOCK " + std::to_string(BLOCK) + "\n\n");
+    m_program_id = load_compute_program(source);
+    glProgramUniform1i(m_program_id,
+                       glGetUniformLocation(m_program_id, "u_Depth"), 0);
+    m_size_location = glGetUniformLocation(m_program_id, "u_Size");
+    m_texels_location = glGetUniformLocation(m_program_id, "u_Texels");
+    glCreateFramebuffers(1, &m_framebuffer_id);
+}
+
+hi_z_t::~hi_z_t() {
+    for (auto &slot : m_slots) {
+        if (slot.fence)
+            glDeleteSync(slot.fence);
+        if (slot.buffer_id != 0)
+            gl::delete_buffers(1, &slot.buffer_id);
+    }
+    glDeleteFramebuffers(1, &m_framebuffer_id);
+    gl::delete_textures(1, &m_depth_texture_id);
+    gl::delete_program(m_program_id);
+}
+
+void hi_z_t::build(int width, int height, matrix_t const &view_projection) {
+    while (m_n_pending > 0 && retire_oldest()) {
+    }
+    // never wait for the GPU; the frame is skipped instead
+    if (m_n_pending == N_SLOTS || width <= 0 || height <= 0)
+        return;
+
+    if (width != m_depth_width || height != m_depth_height) {
+        gl::delete_textures(1, &m_depth_texture_id);
+        glCreateTextures(GL_TEXTURE_2D, 1, &m_depth_texture_id);
+        // a depth blit needs the format of the window's depth buffer; see
+        // is_supported()
+        glTextureStorage2D(m_depth_texture_id, 1, GL_DEPTH24_STENCIL8, width,
+                           height);
+        glTextureParameteri(m_depth_texture_id, GL_TEXTURE_MIN_FILTER,
+                            GL_NEAREST);
+        glTextureParameteri(m_depth_texture_id, GL_TEXTURE_MAG_FILTER,
+                            GL_NEAREST);
+        memory::track_texture(m_depth_texture_id,
+                              std::uint64_t(width) * height * 4,
+                              memory::READBACK, "depth pyramid");
+        glNamedFramebufferTexture(m_framebuffer_id, GL_DEPTH_STENCIL_ATTACHMENT,
+                                  m_depth_texture_id, 0);
+        m_depth_width = width;
+        m_depth_height = height;
+    }
+    // copying a multisampled depth buffer into a texture is an error, a
+    // blit resolves it
+    glBlitNamedFramebuffer(0, m_framebuffer_id, 0, 0, width, height, 0, 0,
+                           width, height, GL_DEPTH_BUFFER_BIT, GL_NEAREST);
+
+    auto &slot = m_slots[(m_head + m_n_pending) % N_SLOTS];
+    int texels_x = (width + BLOCK - 1) / BLOCK;
+    int texels_y = (height + BLOCK - 1) / BLOCK;
+    std::size_t size = std::size_t(texels_x) * texels_y * sizeof(float);
+    if (slot.buffer_id == 0)
+        glCreateBuffers(1, &slot.buffer_id);
+    if (slot.capacity < size) {
+        glNamedBufferData(slot.buffer_id, size, nullptr, GL_STREAM_READ);
+        slot.capacity = size;
+        memory::track_buffer(slot.buffer_id, size, memory::READBACK,
+                             "depth pyramid");
+    }
+
+    gl::use_program(m_program_id);
+    gl::bind_texture_2d(0, m_depth_texture_id);
+    glUniform2i(m_size_location, width, height);
+    glUniform2i(m_texels_location, texels_x, texels_y);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 3, slot.buffer_id);
+    glDispatchCompute((texels_x + 7) / 8, (texels_y + 7) / 8, 1);
+    glMemoryBarrier(GL_BUFFER_UPDATE_BARRIER_BIT);
+
+    slot.fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    slot.width = width;
+    slot.height = height;
+    slot.view_projection = view_projection;
+    m_n_pending++;
+}
+
+bool hi_z_t::retire_oldest() {
+    auto &slot = m_slots[m_head];
+    auto status = glClientWaitSync(slot.fence, GL_SYNC_FLUSH_COMMANDS_BIT, 0);
+    if (status == GL_TIMEOUT_EXPIRED)
+        return false;
+    glDeleteSync(slot.fence);
+    slot.fence = nullptr;
+
+    if (status != GL_WAIT_FAILED) {
+        int texels_x = (slot.width + BLOCK - 1) / BLOCK;
+        int texels_y = (slot.height + BLOCK - 1) / BLOCK;
+        m_readback.resize(std::size_t(texels_x) * texels_y);
+        glGetNamedBufferSubData(slot.buffer_id, 0,
+                                m_readback.size() * sizeof(float),
+                                m_readback.data());
+        m_pyramid.assign(slot.width, slot.height, BLOCK, m_readback,
+                         slot.view_projection);
+    }
+    m_head = (m_head + 1) % N_SLOTS;
+    m_n_pending--;
+    return true;
+}
@@ -0,0 +1,125 @@
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include <protowork/parallel.hpp>
+
+namespace pw = protowork;
+
+namespace {
+
+struct pool_t {
+    explicit pool_t(std::size_t n_threads) {
+        for (std::size_t i = 0; i < n_threads; i++) {
+            m_threads.emplace_back([this, i] { run(i + 1); });
+        }
+    }
+
+    ~pool_t() {
+        {
+            std::lock_guard lock{m_mutex};
+            m_stop = true;
+        }
+        m_wake.notify_all();
+        for (auto &thread : m_threads)
+            thread.join();
+    }
+
+    std::size_t size() const { return m_threads.size() + 1; }
+
+    void dispatch(std::size_t count, std::size_t chunk,
+                  pw::detail::chunk_fn_t const &fn) {
+        {
+            std::lock_guard lock{m_mutex};
+            m_fn = &fn;
+            m_count = count;
+            m_chunk = chunk;
+            m_next.store(0);
+            m_running = m_threads.size();
+            m_generation++;
+        }
+        m_wake.notify_all();
+
+        work(0);
+
+        std::unique_lock lock{m_mutex};
+        m_done.wait(lock, [this] { return m_running == 0; });
+        m_fn = nullptr;
+    }
+
+    std::mutex busy;
+
+private:
+    void work(std::size_t worker) {
+        while (true) {
+            auto begin = m_next.fetch_add(m_chunk);
+            if (begin >= m_count)
+                break;
+            (*m_fn)(begin, std::min(begin + m_chunk, m_count), worker);
+        }
+    }
+
+    void run(std::size_t worker) {
+        std::size_t generation = 0;
+        while (true) {
+            {
+                std::unique_lock lock{m_mutex};
+                m_wake.wait(lock, [&] {
+                    return m_stop || m_generation != generation;
+                });
+                if (m_stop)
+                    return;
+                generation = m_generation;
+            }
+            work(worker);
+            {
+                std::lock_guard lock{m_mutex};
+                m_running--;
+            }
+            m_done.notify_one();
+        }
+    }
+
+    std::vector<std::thread> m_threads;
+    std::mutex m_mutex;
+    std::condition_variable m_wake;
+    std::condition_variable m_done;
+    pw::detail::chunk_fn_t const *m_fn = nullptr;
+    std::size_t m_count = 0;
+    std::size_t m_chunk = 1;
+    std::atomic<std::size_t> m_next = 0;
+    std::size_t m_running = 0;
+    std::size_t m_generation = 0;
+    bool m_stop = false;
+};
+
+pool_t &pool() {
+    static pool_t instance{
+        std::max(std::thread::hardware_concurrency(), 1u) - 1};
+    return instance;
+}
+
+} // namespace
+
+std::size_t pw::detail::worker_count() { return pool().size(); }
+
+void pw::detail::parallel_for(std::size_t count, std::size_t grain,
+                              chunk_fn_t fn) {
+    if (count == 0)
+        return;
+    grain = std::max<std::size_t>(grain, 1);
+
+    auto &instance = pool();
+    std::unique_lock lock{instance.busy, std::try_to_lock};
+    if (count <= grain || instance.size() == 1 || !lock.owns_lock()) {
+        fn(0, count, 0);
+        return;
+    }
+
+    // a few chunks per worker balance uneven chunk costs
+    auto chunk = std::max(grain, count / (instance.size() * 4) + 1);
+    instance.dispatch(count, chunk, fn);
+}
@@ -0,0 +1,145 @@
+#include <cmath>
+
+#include <protowork/font.hpp>
+#include <protowork/world/pick.hpp>
+
+using namespace protowork;
+using namespace protowork::world;
+
+ray_t world::make_ray(camera_t const &camera, double x, double y,
+                      int screen_width, int screen_height) {
+    auto inv = glm::inverse(camera.projection() * camera.view());
+    float ndc_x = 2.f * x / screen_width - 1.f;
+    float ndc_y = 1.f - 2.f * y / screen_height;
+    auto near = inv * glm::vec4{ndc_x, ndc_y, -1.f, 1.f};
+    auto far = inv * glm::vec4{ndc_x, ndc_y, 1.f, 1.f};
+    auto origin = pos_t{near} / near.w;
+    auto target = pos_t{far} / far.w;
+    return ray_t{origin, glm::normalize(target - origin)};
+}
+
+struct triangle_hit_t {
+    float t;
+    glm::vec2 barycentric;
+};
+
+// Moller-Trumbore; t is negative when the triangle is missed
+static triangle_hit_t intersect_triangle(ray_t const &ray, pos_t const &a,
+                                         pos_t const &b, pos_t const &c) {
+    constexpr float EPSILON = 1e-8f;
+    auto edge1 = b - a;
+    auto edge2 = c - a;
+    auto p = glm::cross(ray.direction, edge2);
+    auto det = glm::dot(edge1, p);
+    if (std::abs(det) < EPSILON)
+        return {-1.f, {}};
+    auto inv_det = 1.f / det;
+    auto s = ray.origin - a;
+    auto u = glm::dot(s, p) * inv_det;
+    if (u < 0.f || u > 1.f)
+        return {-1.f, {}};
+    auto q = glm::cross(s, edge1);
+    auto v = glm::dot(ray.direction, q) * inv_det;
+    if (v < 0.f || u + v > 1.f)
+        return {-1.f, {}};
+    return {glm::dot(edge2, q) * inv_det, {u, v}};
+}
+
+std::optional<pick_result_t> picker_t::pick(world_t const &world,
+                                            ray_t const &ray) {
+    auto const &models = world.models;
+    if (m_models != &models || m_version != models.version()) {
+        m_boxes.resize(models.size());
+        for (std::size_t i = 0; i < models.size(); i++) {
+            m_boxes[i] = transform_bounds(models.bounds()[i],
+                                          models.transforms()[i]);
+        }
+        m_scene_bvh.build(m_boxes);
+        m_models = &models;
+        m_version = models.version();
+    }
+
+    std::optional<pick_result_t> result;
+    auto constexpr NO_HIT = std::numeric_limits<float>::max();
+    m_scene_bvh.traverse(ray, NO_HIT, [&](std::uint32_t i, float t_max) {
+        auto const *model = models.render_data()[i];
+        // an affine transform keeps the ray parameter, so distances found
+        // in model space are world distances along the normalized ray
+        auto inv = glm::inverse(models.transforms()[i]);
+        ray_t local{pos_t{inv * glm::vec4{ray.origin, 1.f}},
+                    glm::vec3{inv * glm::vec4{ray.direction, 0.f}}};
+
+        auto nearest = NO_HIT;
+        auto const &vertices = model->vertices;
+        auto const &indices = model->indices;
+        model->triangle_bvh().traverse(
+            local, t_max, [&](std::uint32_t triangle, float t_max) {
+                auto hit = intersect_triangle(
+                    local, vertices[indices[triangle * 3 + 0]],
+                    vertices[indices[triangle * 3 + 1]],
+                    vertices[indices[triangle * 3 + 2]]);
+                if (hit.t < 0.f || hit.t >= t_max)
+                    return NO_HIT;
+                nearest = hit.t;
+                result = pick_result_t{pick_result_t::kind_t::MODEL,
+                                       models.handle(i), triangle,
+                                       hit.barycentric, hit.t};
+                return hit.t;
+            });
+        return nearest;
+    });
+    return result;
+}
+
+std::optional<pick_result_t> picker_t::pick(world_t const &world, double x,
+                                            double y, int screen_width,
+                                            int screen_height) {
+    auto const &camera = world.camera;
+    auto view = camera.view();
+    auto MVP = camera.projection() * view;
+    auto eye = pos_t{glm::inverse(view)[3]};
+    // labels are laid out from the bottom left corner of the window
+    auto mouse_x = static_cast<float>(x);
+    auto mouse_y = static_cast<float>(screen_height - y);
+
+    std::optional<pick_result_t> result;
+    for (std::size_t i = 0; i < world.texts_3d.size(); i++) {
+        auto const &text = *world.texts_3d[i];
+        auto const *font_data = font::find(font::key_t{text.font_size});
+        if (font_data == nullptr)
+            continue;
+        auto pos = MVP * glm::vec4{text.pos, 1.f};
+        if (pos.w <= 0.f)
+            continue;
+
+        // same placement as text3d_t::append
+        int left = (pos.x / pos.w + 1.f) * screen_width / 2.f;
+        int baseline = (pos.y / pos.w + 1.f) * screen_height / 2.f;
+        int right = left;
+        int top = baseline;
+        int bottom = baseline;
+        for (auto c : text.text) {
+            auto found = font_data->char_infos.find(c);
+            if (found == font_data->char_infos.end())
+                continue;
+            auto const &info = found->second;
+            top = std::max(top, baseline + info.bearing_y);
+            bottom = std::min(bottom, baseline + info.bearing_y - info.height);
+            right += info.advance_x;
+        }
+        if (mouse_x < left || mouse_x > right || mouse_y < bottom ||
+            mouse_y > top)
+            continue;
+
+        auto distance = glm::length(text.pos - eye);
+        if (!result || distance < result->distance) {
+            result = pick_result_t{pick_result_t::kind_t::LABEL,
+                                   world.texts_3d.handle(i), 0,
+                                   glm::vec2(0.f), distance};
+        }
+    }
+    if (result)
+        return result;
+
+    return pick(world, make_ray(camera, x, y, screen_width, screen_height));
+}
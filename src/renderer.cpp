@@ -0,0 +1,606 @@
+#include <algorithm>
+#include <atomic>
+#include <utility>
+
+#include <GL/glew.h>
+#include <GLFW/glfw3.h>
+
+#include <protowork/renderer.hpp>
+#include <protowork/font.hpp>
+#include <protowork/gl.hpp>
+#include <protowork/memory.hpp>
+#include <protowork/parallel.hpp>
+
+using namespace protowork;
+
+// written on the GL thread and reset from any, so updates are read-modify-
+// write operations; no ordering with other data is needed
+namespace {
+struct counter_t {
+    std::atomic<std::uint64_t> value = 0;
+
+    void operator+=(std::uint64_t n) {
+        value.fetch_add(n, std::memory_order_relaxed);
+    }
+    std::uint64_t load() const {
+        return value.load(std::memory_order_relaxed);
+    }
+    void reset() { value.exchange(0, std::memory_order_relaxed); }
+};
+} // namespace
+
+static struct {
+    counter_t models_drawn;
+    counter_t models_outside;
+    counter_t models_occluded;
+    counter_t texts_occluded;
+    counter_t fragments_shaded;
+    counter_t fragments_avoided;
+} g_stats;
+
+cull_stats_t protowork::cull_stats() {
+    return cull_stats_t{g_stats.models_drawn.load(),
+                        g_stats.models_outside.load(),
+                        g_stats.models_occluded.load(),
+                        g_stats.texts_occluded.load(),
+                        g_stats.fragments_shaded.load(),
+                        g_stats.fragments_avoided.load()};
+}
+
+void protowork::reset_cull_stats() {
+    g_stats.models_drawn.reset();
+    g_stats.models_outside.reset();
+    g_stats.models_occluded.reset();
+    g_stats.texts_occluded.reset();
+    g_stats.fragments_shaded.reset();
+    g_stats.fragments_avoided.reset();
+}
+
+void snapshot_t::capture(world_t const &world, ui_t const &ui,
+                         int screen_width, int screen_height,
+                         bool publish_geometry) {
+    this->screen_width = screen_width;
+    this->screen_height = screen_height;
+    projection = world.camera.projection();
+    view = world.camera.view();
+
+    auto const &render_data = world.models.render_data();
+    models.assign(render_data.begin(), render_data.end());
+    model_matrices = world.models.transforms();
+    model_bounds = world.models.bounds();
+    model_revisions = world.models.revisions();
+    model_materials.resize(models.size());
+    for (std::size_t i = 0; i < models.size(); i++)
+        model_materials[i] = models[i]->material;
+
+    model_geometries.clear();
+    model_owners.clear();
+    if (publish_geometry) {
+        for (auto const &model : world.models) {
+            model_geometries.push_back(model->publish_geometry());
+            model_owners.push_back(model);
+        }
+    }
+
+    // assign element-wise to reuse string buffers of the previous capture
+    texts_2d.resize(ui.texts_2d.size());
+    for (std::size_t i = 0; i < texts_2d.size(); i++) {
+        texts_2d[i] = *ui.texts_2d[i];
+    }
+    texts_3d.resize(world.texts_3d.size());
+    for (std::size_t i = 0; i < texts_3d.size(); i++) {
+        texts_3d[i] = *world.texts_3d[i];
+    }
+
+    lights.resize(world.lights.size());
+    for (std::size_t i = 0; i < lights.size(); i++) {
+        lights[i] = *world.lights[i];
+    }
+    directional_light = world.directional_light;
+}
+
+using frustum_t = std::array<glm::vec4, 6>;
+
+// planes of the view volume in world space, pointing inwards
+static frustum_t make_frustum(matrix_t const &view_projection) {
+    auto const &m = view_projection;
+    frustum_t planes;
+    for (int i = 0; i < 3; i++) {
+        glm::vec4 row{m[0][i], m[1][i], m[2][i], m[3][i]};
+        glm::vec4 w{m[0][3], m[1][3], m[2][3], m[3][3]};
+        planes[i * 2 + 0] = w + row;
+        planes[i * 2 + 1] = w - row;
+    }
+    return planes;
+}
+
+static bool is_outside(frustum_t const &frustum, aabb_t const &box) {
+    if (box.empty())
+        return true;
+    for (auto const &plane : frustum) {
+        // the corner farthest along the plane normal
+        pos_t corner{plane.x >= 0.f ? box.max.x : box.min.x,
+                     plane.y >= 0.f ? box.max.y : box.min.y,
+                     plane.z >= 0.f ? box.max.z : box.min.z};
+        if (glm::dot(pos_t{plane}, corner) + plane.w < 0.f)
+            return true;
+    }
+    return false;
+}
+
+renderer_t::renderer_t(render_options_t const &options)
+    : m_options{options}, m_lists(detail::worker_count()) {
+    gl::invalidate();
+
+    glClearColor(0.0f, 0.0f, 0.4f, 0.0f);
+
+    gl::set_capability(GL_DEPTH_TEST, true);
+    glDepthFunc(GL_LESS);
+    gl::set_capability(GL_CULL_FACE, true);
+    glPointSize(10.0f);
+
+    world::model_t::initialize();
+    font::initialize();
+    // without a depth buffer to resolve, models are never culled by depth
+    if (options.occlusion_culling && detail::hi_z_t::is_supported())
+        m_hi_z = std::make_unique<detail::hi_z_t>();
+}
+
+renderer_t::~renderer_t() {
+    for (auto &query : m_queries) {
+        if (query.shading_id != 0) {
+            glDeleteQueries(1, &query.prepass_id);
+            glDeleteQueries(1, &query.shading_id);
+        }
+    }
+    memory::untrack_host(this);
+    m_hi_z.reset();
+    font::finalize();
+    world::model_t::finalize();
+    detail::flush_released_objects();
+}
+
+void renderer_t::render(snapshot_t const &snapshot) {
+    detail::flush_released_objects();
+    m_arena.reset();
+    // in pixels, which differ from screen coordinates on HiDPI displays
+    glfwGetFramebufferSize(glfwGetCurrentContext(), &m_framebuffer_width,
+                           &m_framebuffer_height);
+
+    record(snapshot);
+    sort_packets(m_lists, m_order, m_scratch);
+    m_clusters.build(snapshot.lights, snapshot.directional_light,
+                     snapshot.projection, snapshot.view, m_framebuffer_width,
+                     m_framebuffer_height);
+    m_clusters.bind();
+
+    glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+    replay(snapshot);
+
+    if (!snapshot.captures.empty()) {
+        if (!m_capture)
+            m_capture = std::make_unique<detail::frame_capture_t>();
+        m_capture->read(m_framebuffer_width, m_framebuffer_height,
+                        snapshot.captures);
+    }
+    if (m_capture)
+        m_capture->poll(false);
+    enforce_budgets(snapshot);
+}
+
+void renderer_t::rethrow_capture_error() {
+    if (m_capture)
+        m_capture->rethrow_if_failed();
+}
+
+void renderer_t::enforce_budgets(snapshot_t const &snapshot) {
+    std::size_t command_bytes =
+        (m_order.capacity() + m_scratch.capacity()) * sizeof(sorted_packet_t);
+    for (auto const &list : m_lists)
+        command_bytes += list.capacity_bytes();
+    memory::track_host(this, command_bytes, memory::FRAME, "command lists");
+
+    // atlases drawn this frame are kept, so text stays legible even when
+    // the budget is too small
+    auto budget = memory::budget(memory::FONT_ATLAS);
+    font::evict(budget == 0 ? UINT64_MAX : budget, &m_arena);
+
+    budget = memory::budget(memory::GEOMETRY);
+    auto resident = memory::stats().gpu[memory::GEOMETRY].bytes;
+    if (budget == 0 || resident <= budget)
+        return;
+    std::pmr::vector<world::model_t const *> evictable{&m_arena};
+    for (auto const *model : snapshot.models) {
+        if (model->gpu_bytes() > 0 &&
+            model->last_drawn() != world::model_t::current_frame())
+            evictable.push_back(model);
+    }
+    std::sort(evictable.begin(), evictable.end(),
+              [](auto const *a, auto const *b) {
+                  return a->last_drawn() < b->last_drawn();
+              });
+    for (auto const *model : evictable) {
+        if (resident <= budget)
+            break;
+        // a model may appear more than once in the snapshot
+        auto bytes = model->gpu_bytes();
+        if (bytes == 0)
+            continue;
+        model->evict();
+        resident -= std::min<std::uint64_t>(resident, bytes);
+    }
+}
+
+void renderer_t::record(snapshot_t const &snapshot) {
+    for (auto &list : m_lists)
+        list.clear();
+
+    // glyph atlases are created on the GL thread before workers read them
+    int last_font_size = -1;
+    auto prepare_font = [&](int font_size) {
+        if (font_size != last_font_size)
+            font::get(font::key_t{font_size});
+        last_font_size = font_size;
+    };
+    for (auto const &text : snapshot.texts_2d)
+        prepare_font(text.font_size);
+    for (auto const &text : snapshot.texts_3d)
+        prepare_font(text.font_size);
+
+    auto const &matrices = snapshot.model_matrices;
+    auto const &bounds = snapshot.model_bounds;
+    auto const &geometries = snapshot.model_geometries;
+    auto frustum = make_frustum(snapshot.projection * snapshot.view);
+    // depth of an earlier frame; nothing is occluded until one was read back
+    auto const *pyramid =
+        m_hi_z && !m_hi_z->pyramid().empty() ? &m_hi_z->pyramid() : nullptr;
+    std::atomic<std::uint64_t> n_outside = 0, n_occluded = 0;
+    detail::parallel_for(
+        snapshot.models.size(), 64,
+        [&](std::size_t begin, std::size_t end, std::size_t worker) {
+            auto &list = m_lists[worker];
+            std::uint64_t outside = 0, occluded = 0;
+            for (auto i = begin; i < end; i++) {
+                auto world_bounds = transform_bounds(bounds[i], matrices[i]);
+                if (is_outside(frustum, world_bounds)) {
+                    outside++;
+                    continue;
+                }
+                if (pyramid && pyramid->is_occluded(world_bounds)) {
+                    occluded++;
+                    continue;
+                }
+                auto origin = snapshot.view * matrices[i][3];
+                auto const &material = snapshot.model_materials[i];
+                auto key =
+                    sort_key::make(sort_key::OPAQUE, material.sort_state(),
+                                   sort_key::depth_order(-origin.z));
+                list.draw_model(key, snapshot.models[i],
+                                geometries.empty() ? nullptr
+                                                   : geometries[i].get(),
+                                snapshot.model_revisions[i], matrices[i],
+                                &material);
+            }
+            n_outside += outside;
+            n_occluded += occluded;
+        });
+    g_stats.models_drawn += snapshot.models.size() - n_outside - n_occluded;
+    g_stats.models_outside += n_outside;
+    g_stats.models_occluded += n_occluded;
+
+    auto const &texts_2d = snapshot.texts_2d;
+    auto const &texts_3d = snapshot.texts_3d;
+    glm::mat4 MVP = snapshot.projection * snapshot.view;
+    std::atomic<std::uint64_t> n_texts_occluded = 0;
+    detail::parallel_for(
+        texts_2d.size() + texts_3d.size(), 256,
+        [&](std::size_t begin, std::size_t end, std::size_t worker) {
+            auto &list = m_lists[worker];
+            std::uint64_t occluded = 0;
+            for (auto i = begin; i < end; i++) {
+                if (i < texts_2d.size()) {
+                    auto const &text = texts_2d[i];
+                    auto &batch = list.text_batch(text.font_size);
+                    text.append(batch.vertices, batch.uvs);
+                } else {
+                    auto const &text = texts_3d[i - texts_2d.size()];
+                    if (pyramid) {
+                        // pixels of the label to NDC
+                        auto extent = text.extent();
+                        glm::vec2 scale{2.f / snapshot.screen_width,
+                                        2.f / snapshot.screen_height};
+                        if (pyramid->is_occluded(
+                                text.pos, glm::vec2{extent.x, extent.y} * scale,
+                                glm::vec2{extent.z, extent.w} * scale)) {
+                            occluded++;
+                            continue;
+                        }
+                    }
+                    auto &batch = list.text_batch(text.font_size);
+                    text.append(snapshot.screen_width, snapshot.screen_height,
+                                MVP, batch.vertices, batch.uvs);
+                }
+            }
+            n_texts_occluded += occluded;
+        });
+    g_stats.texts_occluded += n_texts_occluded;
+
+    for (auto &list : m_lists)
+        list.finish();
+}
+
+void renderer_t::replay(snapshot_t const &snapshot) {
+    // opaque packets sort first
+    std::size_t opaque_end = 0;
+    while (opaque_end < m_order.size() &&
+           m_order[opaque_end].key >> 60 == sort_key::OPAQUE)
+        opaque_end++;
+    replay_opaque(snapshot, opaque_end);
+    if (m_hi_z)
+        m_hi_z->build(m_framebuffer_width, m_framebuffer_height,
+                      snapshot.projection * snapshot.view);
+
+    auto pass = UINT64_MAX;
+    for (std::size_t i = opaque_end; i < m_order.size(); i++) {
+        auto const &packet = *m_order[i].packet;
+        auto packet_pass = packet.key >> 60;
+        if (packet_pass != pass) {
+            pass = packet_pass;
+            if (pass == sort_key::OVERLAY)
+                font::before_drawing();
+        }
+
+        switch (packet.kind) {
+        case draw_packet_t::kind_t::MODEL:
+            // models are opaque only
+            break;
+        case draw_packet_t::kind_t::TEXT: {
+            // batches of one font recorded by several workers are adjacent
+            // after sorting and are drawn with a single call
+            auto const *vertices = packet.vertices;
+            auto const *uvs = packet.uvs;
+            auto count = packet.vertex_count;
+            auto same_font = [&](std::size_t j) {
+                auto const &next = *m_order[j].packet;
+                return next.kind == draw_packet_t::kind_t::TEXT &&
+                       next.font_size == packet.font_size;
+            };
+            std::size_t last = i;
+            while (last + 1 < m_order.size() && same_font(last + 1)) {
+                last++;
+                count += m_order[last].packet->vertex_count;
+            }
+            std::pmr::vector<glm::vec2> merged_vertices{&m_arena};
+            std::pmr::vector<glm::vec2> merged_uvs{&m_arena};
+            if (last > i) {
+                // sized up front, since the arena never reuses memory
+                // within a frame
+                merged_vertices.reserve(count);
+                merged_uvs.reserve(count);
+                for (; i <= last; i++) {
+                    auto const &next = *m_order[i].packet;
+                    merged_vertices.insert(merged_vertices.end(),
+                                           next.vertices,
+                                           next.vertices + next.vertex_count);
+                    merged_uvs.insert(merged_uvs.end(), next.uvs,
+                                      next.uvs + next.vertex_count);
+                }
+                i = last;
+                vertices = merged_vertices.data();
+                uvs = merged_uvs.data();
+            }
+            font::render(snapshot.screen_width, snapshot.screen_height,
+                         packet.font_size, vertices, uvs, count);
+            break;
+        }
+        }
+    }
+}
+
+void renderer_t::replay_opaque(snapshot_t const &snapshot, std::size_t end) {
+    world::model_t::before_drawing(snapshot.projection, snapshot.view,
+                                   m_clusters.params());
+    auto *query = begin_fragment_query();
+    bool prepass = m_options.depth_prepass && end > 0;
+
+    if (prepass) {
+        // invariant: the shading pass draws exactly the geometry drawn
+        // here, since it writes no depth. models upload geometry on their
+        // first draw of a frame only (see model_t::draw() and
+        // mapped_model_t::draw()), so both passes see the same data.
+        // fragments passing the depth test here are those the shading pass
+        // would shade without the pre-pass, since packets are drawn in the
+        // same order
+        glColorMask(GL_FALSE, GL_FALSE, GL_FALSE, GL_FALSE);
+        world::model_t::use_depth_only();
+        if (query)
+            glBeginQuery(GL_SAMPLES_PASSED, query->prepass_id);
+        for (std::size_t i = 0; i < end; i++) {
+            auto const &packet = *m_order[i].packet;
+            packet.model->draw(packet.model_matrix, packet.geometry,
+                               packet.revision);
+        }
+        if (query)
+            glEndQuery(GL_SAMPLES_PASSED);
+        // only the nearest fragment of each pixel passes from now on
+        glColorMask(GL_TRUE, GL_TRUE, GL_TRUE, GL_TRUE);
+        glDepthFunc(GL_LEQUAL);
+        glDepthMask(GL_FALSE);
+    }
+
+    if (query) {
+        query->has_prepass = prepass;
+        glBeginQuery(GL_SAMPLES_PASSED, query->shading_id);
+    }
+    world::material_t const *material = nullptr;
+    for (std::size_t i = 0; i < end; i++) {
+        auto const &packet = *m_order[i].packet;
+        if (!material || *material != *packet.material) {
+            material = packet.material;
+            world::model_t::use_material(*material);
+        }
+        packet.model->draw(packet.model_matrix, packet.geometry,
+                           packet.revision);
+    }
+    if (query)
+        glEndQuery(GL_SAMPLES_PASSED);
+
+    if (prepass) {
+        glDepthMask(GL_TRUE);
+        glDepthFunc(GL_LESS);
+    }
+}
+
+renderer_t::fragment_query_t *renderer_t::begin_fragment_query() {
+    // results are collected once available, a few frames later
+    for (auto &query : m_queries) {
+        if (!query.pending)
+            continue;
+        GLuint available = GL_FALSE;
+        glGetQueryObjectuiv(query.shading_id, GL_QUERY_RESULT_AVAILABLE,
+                            &available);
+        if (!available)
+            continue;
+        GLuint64 shaded = 0, drawn = 0;
+        glGetQueryObjectui64v(query.shading_id, GL_QUERY_RESULT, &shaded);
+        g_stats.fragments_shaded += shaded;
+        if (query.has_prepass) {
+            glGetQueryObjectui64v(query.prepass_id, GL_QUERY_RESULT, &drawn);
+            g_stats.fragments_avoided += drawn > shaded ? drawn - shaded : 0;
+        }
+        query.pending = false;
+    }
+
+    // without a free query the frame is not counted rather than waited for
+    auto &query = m_queries[m_next_query];
+    if (query.pending)
+        return nullptr;
+    if (query.shading_id == 0) {
+        glGenQueries(1, &query.prepass_id);
+        glGenQueries(1, &query.shading_id);
+    }
+    query.pending = true;
+    m_next_query = (m_next_query + 1) % m_queries.size();
+    return &query;
+}
+
+void detail::set_vsync(vsync_t vsync) {
+    switch (vsync) {
+    case vsync_t::OFF:
+        glfwSwapInterval(0);
+        break;
+    case vsync_t::ON:
+        glfwSwapInterval(1);
+        break;
+    case vsync_t::ADAPTIVE:
+        // negative intervals require swap_control_tear
+        if (glfwExtensionSupported("GLX_EXT_swap_control_tear") ||
+            glfwExtensionSupported("WGL_EXT_swap_control_tear"))
+            glfwSwapInterval(-1);
+        else
+            glfwSwapInterval(1);
+        break;
+    }
+}
+
+detail::render_thread_t::render_thread_t(GLFWwindow *window, vsync_t vsync,
+                                         render_options_t const &options)
+    : m_window{window}, m_vsync{vsync}, m_options{options} {
+    // the context can be current on only one thread at a time
+    glfwMakeContextCurrent(nullptr);
+
+    std::promise<void> initialized;
+    auto initialized_future = initialized.get_future();
+    m_thread = std::thread{[this, &initialized] { run(initialized); }};
+    try {
+        initialized_future.get();
+    } catch (...) {
+        m_thread.join();
+        throw;
+    }
+}
+
+detail::render_thread_t::~render_thread_t() {
+    {
+        std::lock_guard lock{m_mutex};
+        m_stop = true;
+    }
+    m_condition.notify_one();
+    m_thread.join();
+}
+
+void detail::render_thread_t::publish() {
+    {
+        std::lock_guard lock{m_mutex};
+        std::swap(m_back, m_ready);
+        if (m_has_ready) {
+            // the replaced snapshot is never rendered
+            auto &dropped = m_snapshots[m_back].captures;
+            auto &captures = m_snapshots[m_ready].captures;
+            for (auto &target : dropped) {
+                if (std::find(captures.begin(), captures.end(), target) ==
+                    captures.end())
+                    captures.push_back(std::move(target));
+            }
+            dropped.clear();
+        }
+        m_has_ready = true;
+    }
+    m_condition.notify_one();
+}
+
+void detail::render_thread_t::rethrow_if_failed() {
+    std::lock_guard lock{m_mutex};
+    if (m_error)
+        std::rethrow_exception(m_error);
+}
+
+void detail::render_thread_t::rethrow_capture_error() {
+    std::lock_guard lock{m_mutex};
+    if (m_capture_error)
+        std::rethrow_exception(std::exchange(m_capture_error, nullptr));
+}
+
+void detail::render_thread_t::run(std::promise<void> &initialized) {
+    glfwMakeContextCurrent(m_window);
+    set_vsync(m_vsync);
+    std::unique_ptr<renderer_t> renderer;
+    try {
+        renderer = std::make_unique<renderer_t>(m_options);
+    } catch (...) {
+        glfwMakeContextCurrent(nullptr);
+        initialized.set_exception(std::current_exception());
+        return;
+    }
+    initialized.set_value();
+
+    try {
+        while (true) {
+            {
+                std::unique_lock lock{m_mutex};
+                m_condition.wait(lock,
+                                 [this] { return m_has_ready || m_stop; });
+                if (m_stop)
+                    break;
+                std::swap(m_front, m_ready);
+                m_has_ready = false;
+            }
+            renderer->render(m_snapshots[m_front]);
+            glfwSwapBuffers(m_window);
+            // a failed capture must not stop rendering
+            try {
+                renderer->rethrow_capture_error();
+            } catch (...) {
+                std::lock_guard lock{m_mutex};
+                if (!m_capture_error)
+                    m_capture_error = std::current_exception();
+            }
+        }
+    } catch (...) {
+        std::lock_guard lock{m_mutex};
+        m_error = std::current_exception();
+    }
+
+    renderer.reset();
+    glfwMakeContextCurrent(nullptr);
+}
@@ -0,0 +1,155 @@
+#include <algorithm>
+#include <bit>
+#include <cstring>
+#include <numeric>
+#include <stdexcept>
+
+#include <protowork/replay.hpp>
+
+using namespace protowork;
+
+static constexpr char MAGIC[8] = {'P', 'W', 'I', 'N', 'P', 'U', 'T', '\0'};
+static constexpr std::uint32_t VERSION = 1;
+static constexpr std::size_t EVENT_SIZE = 4 + 4 + 4 + 3 * 8;
+// far more than a frame gets; larger counts come from corrupt logs
+static constexpr std::uint32_t MAX_EVENTS = 1u << 16;
+
+// values are stored little endian; bytes are swapped on big endian hosts
+static void to_little_endian(char *bytes, std::size_t size) {
+    if constexpr (std::endian::native == std::endian::big)
+        std::reverse(bytes, bytes + size);
+}
+
+template <typename T> static void put(std::vector<char> &buffer, T value) {
+    auto size = buffer.size();
+    buffer.resize(size + sizeof(T));
+    std::memcpy(buffer.data() + size, &value, sizeof(T));
+    to_little_endian(buffer.data() + size, sizeof(T));
+}
+
+template <typename T> static T get(char const *&p) {
+    char bytes[sizeof(T)];
+    std::memcpy(bytes, p, sizeof(T));
+    to_little_endian(bytes, sizeof(T));
+    p += sizeof(T);
+    T value;
+    std::memcpy(&value, bytes, sizeof(T));
+    return value;
+}
+
+template <typename T> static T read(std::ifstream &in) {
+    char bytes[sizeof(T)] = {};
+    in.read(bytes, sizeof(T));
+    char const *p = bytes;
+    return get<T>(p);
+}
+
+input_recorder_t::input_recorder_t(std::string const &path,
+                                   input_t const &initial)
+    : m_out{path, std::ios::binary | std::ios::trunc} {
+    if (!m_out)
+        throw std::runtime_error{"failed to create " + path};
+    m_out.write(MAGIC, sizeof(MAGIC));
+    put(m_buffer, VERSION);
+    put(m_buffer, initial.mouse.x);
+    put(m_buffer, initial.mouse.y);
+    m_out.write(m_buffer.data(), m_buffer.size());
+}
+
+void input_recorder_t::record(input_t const &input) {
+    m_buffer.clear();
+    put(m_buffer, input.time);
+    put(m_buffer, static_cast<std::uint32_t>(input.events.size()));
+    for (auto const &event : input.events) {
+        put(m_buffer, static_cast<std::uint8_t>(event.kind));
+        put(m_buffer, static_cast<std::uint8_t>(event.action));
+        put(m_buffer, std::uint16_t{0});
+        put(m_buffer, static_cast<std::int32_t>(event.code));
+        put(m_buffer, static_cast<std::int32_t>(event.mods));
+        put(m_buffer, event.x);
+        put(m_buffer, event.y);
+        put(m_buffer, event.time);
+    }
+    m_out.write(m_buffer.data(), m_buffer.size());
+    if (!m_out)
+        throw std::runtime_error{"failed to write input log"};
+}
+
+input_player_t::input_player_t(std::string const &path, input_t &input,
+                               double step)
+    : m_in{path, std::ios::binary}, m_step{step} {
+    if (!m_in)
+        throw std::runtime_error{"failed to open " + path};
+    char magic[sizeof(MAGIC)];
+    m_in.read(magic, sizeof(magic));
+    auto version = read<std::uint32_t>(m_in);
+    auto x = read<double>(m_in);
+    auto y = read<double>(m_in);
+    if (!m_in || std::memcmp(magic, MAGIC, sizeof(MAGIC)) != 0)
+        throw std::runtime_error{path + ": not an input log"};
+    if (version != VERSION)
+        throw std::runtime_error{path + ": unsupported version"};
+    input.mouse.x = x;
+    input.mouse.y = y;
+}
+
+bool input_player_t::next(input_t &input) {
+    input.begin_frame();
+    auto recorded_time = read<double>(m_in);
+    auto count = read<std::uint32_t>(m_in);
+    if (!m_in)
+        return false;
+    if (count > MAX_EVENTS)
+        throw std::runtime_error{"corrupt input log"};
+
+    m_buffer.resize(count * EVENT_SIZE);
+    m_in.read(m_buffer.data(), m_buffer.size());
+    if (!m_in)
+        return false;
+
+    input.time = m_frame * m_step;
+    char const *p = m_buffer.data();
+    for (std::uint32_t i = 0; i < count; i++) {
+        event_t event;
+        event.kind = static_cast<event_t::kind_t>(get<std::uint8_t>(p));
+        event.action = static_cast<event_t::action_t>(get<std::uint8_t>(p));
+        get<std::uint16_t>(p);
+        event.code = get<std::int32_t>(p);
+        event.mods = get<std::int32_t>(p);
+        event.x = get<double>(p);
+        event.y = get<double>(p);
+        // keep the offset to the frame, which the events preceded
+        event.time = input.time + (get<double>(p) - recorded_time);
+        input.apply(event);
+    }
+    m_frame++;
+    return true;
+}
+
+double frame_stats_t::mean() const {
+    if (m_frame_times.empty())
+        return 0.0;
+    return std::accumulate(m_frame_times.begin(), m_frame_times.end(), 0.0) /
+           m_frame_times.size();
+}
+
+double frame_stats_t::percentile(double p) const {
+    if (m_frame_times.empty())
+        return 0.0;
+    auto sorted = m_frame_times;
+    auto n = static_cast<std::size_t>(std::clamp(p, 0.0, 1.0) *
+                                      (sorted.size() - 1));
+    std::nth_element(sorted.begin(), sorted.begin() + n, sorted.end());
+    return sorted[n];
+}
+
+void frame_stats_t::write_csv(std::string const &path) const {
+    std::ofstream out{path, std::ios::trunc};
+    if (!out)
+        throw std::runtime_error{"failed to create " + path};
+    out << "frame,seconds\n";
+    for (std::size_t i = 0; i < m_frame_times.size(); i++)
+        out << i << ',' << m_frame_times[i] << '\n';
+    if (!out)
+        throw std::runtime_error{"failed to write " + path};
+}
@@ -0,0 +1,46 @@
+#include <stdexcept>
+#include <protowork/store.hpp>
+
+using namespace protowork;
+
+handle_t detail::slot_table_t::insert(std::uint32_t dense) {
+    if (m_free.empty()) {
+        m_slots.push_back(slot_t{dense, 0});
+        return handle_t{static_cast<std::uint32_t>(m_slots.size() - 1), 0};
+    }
+    auto index = m_free.back();
+    m_free.pop_back();
+    m_slots[index].dense = dense;
+    return handle_t{index, m_slots[index].generation};
+}
+
+std::uint32_t detail::slot_table_t::erase(handle_t handle) {
+    auto dense = this->dense(handle);
+    // bumping the generation invalidates all handles to this slot
+    m_slots[handle.index].generation++;
+    m_free.push_back(handle.index);
+    return dense;
+}
+
+void detail::slot_table_t::relocate(handle_t handle, std::uint32_t dense) {
+    m_slots[handle.index].dense = dense;
+}
+
+void detail::slot_table_t::clear() {
+    m_free.clear();
+    for (std::uint32_t i = 0; i < m_slots.size(); i++) {
+        m_slots[i].generation++;
+        m_free.push_back(i);
+    }
+}
+
+bool detail::slot_table_t::contains(handle_t handle) const {
+    return handle.index < m_slots.size() &&
+           m_slots[handle.index].generation == handle.generation;
+}
+
+std::uint32_t detail::slot_table_t::dense(handle_t handle) const {
+    if (!contains(handle))
+        throw std::out_of_range{"invalid or removed handle"};
+    return m_slots[handle.index].dense;
+}
@@ -1,4 +1,6 @@
+#include <algorithm>
 #include <array>
+#include <cfloat>
 #include <map>
 #include <memory>
 #include <vector>
@@ -67,12 +69,32 @@ void ui::text2d_t::append(std::vector<glm::vec2> &vertices,
     draw_impl(x, y, font_size, text, vertices, uvs);
 }
 
-void world::text3d_t::append(GLFWwindow *window, glm::mat4 const &mat,
+glm::vec4 world::text3d_t::extent() const {
+    auto const *font_data = font::find(font::key_t{font_size});
+    if (!font_data || text.empty())
+        return glm::vec4{0.f};
+    // same layout as draw_impl()
+    glm::vec4 result{FLT_MAX, FLT_MAX, -FLT_MAX, -FLT_MAX};
+    int x = 0;
+    for (char c : text) {
+        auto const &info = font_data->char_infos.at(c);
+        auto left = x + info.bearing_x;
+        result.x = std::min<float>(result.x, left);
+        result.y = std::min<float>(result.y, info.bearing_y - info.height);
+        result.z = std::max<float>(result.z, left + info.width);
+        result.w = std::max<float>(result.w, info.bearing_y);
+        x += info.advance_x;
+    }
+    return result;
+}
+
+void world::text3d_t::append(int screen_width, int screen_height,
+                             glm::mat4 const &mat,
                              std::vector<glm::vec2> &vertices,
                              std::vector<glm::vec2> &uvs) const {
-    int screen_width, screen_height;
-    glfwGetWindowSize(window, &screen_width, &screen_height);
     auto pos = mat * glm::vec4{this->pos, 1.f};
+    if (pos.w <= 0.f) // behind the camera
+        return;
 
     int x = (pos.x / pos.w + 1.f) * screen_width / 2.f;
     int y = (pos.y / pos.w + 1.f) * screen_height / 2.f;
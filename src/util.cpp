@@ -0,0 +1,54 @@
+#include <mutex>
+#include <vector>
+#include <protowork/util.hpp>
+#include <protowork/gl.hpp>
+
+namespace pw = protowork;
+
+static std::mutex g_released_mutex;
+static std::vector<pw::id_t> g_released_buffers;
+static std::vector<pw::id_t> g_released_vertex_arrays;
+
+void pw::detail::release_buffers(std::initializer_list<id_t> ids) {
+    std::lock_guard lock{g_released_mutex};
+    for (auto id : ids) {
+        if (id != 0)
+            g_released_buffers.push_back(id);
+    }
+}
+
+void pw::detail::release_vertex_arrays(std::initializer_list<id_t> ids) {
+    std::lock_guard lock{g_released_mutex};
+    for (auto id : ids) {
+        if (id != 0)
+            g_released_vertex_arrays.push_back(id);
+    }
+}
+
+void pw::detail::flush_released_objects() {
+    std::lock_guard lock{g_released_mutex};
+    if (!g_released_buffers.empty()) {
+        gl::delete_buffers(g_released_buffers.size(),
+                           g_released_buffers.data());
+        g_released_buffers.clear();
+    }
+    if (!g_released_vertex_arrays.empty()) {
+        gl::delete_vertex_arrays(g_released_vertex_arrays.size(),
+                                 g_released_vertex_arrays.data());
+        g_released_vertex_arrays.clear();
+    }
+}
+
+pw::aabb_t pw::transform_bounds(aabb_t const &box, matrix_t const &m) {
+    if (box.empty())
+        return box;
+    // center/extent form: the extent is transformed by |m|
+    auto center = (box.min + box.max) * 0.5f;
+    auto extent = (box.max - box.min) * 0.5f;
+    auto new_center = pos_t{m * glm::vec4{center, 1.f}};
+    pos_t new_extent{0.f};
+    for (int i = 0; i < 3; i++) {
+        new_extent += glm::abs(pos_t{m[i]}) * extent[i];
+    }
+    return aabb_t{new_center - new_extent, new_center + new_extent};
+}
@@ -1,11 +1,27 @@
+#include <atomic>
 #include <cassert>
+#include <cstdlib>
 #include <iostream>
 #include <cmath>
+#include <new>
 #include <protowork.hpp>
 #include <protowork/world.hpp>
 
 namespace pw = protowork;
 
+// heap allocations of all threads, to check that steady-state frames do
+// not allocate
+static std::atomic<std::size_t> g_allocations = 0;
+
+void *operator new(std::size_t size) {
+    g_allocations.fetch_add(1, std::memory_order_relaxed);
+    if (auto *p = std::malloc(size == 0 ? 1 : size))
+        return p;
+    throw std::bad_alloc{};
+}
+void operator delete(void *p) noexcept { std::free(p); }
+void operator delete(void *p, std::size_t) noexcept { std::free(p); }
+
 pw::pos_t angle_to_pos(float phi, float theta) {
     float sin_phi = std::sin(phi);
     float cos_phi = std::cos(phi);
@@ -71,8 +87,19 @@ int main() {
     auto app = pw::app_t{800, 600, "all test window"};
 
     auto sphere = std::make_shared<sphere_object_t>();
+    for (auto const &normal : sphere->normals)
+        sphere->colors.push_back(normal * 0.5f + 0.5f);
+    sphere->material =
+        pw::world::make_material<pw::world::VERTEX_COLOR>(glm::vec3{1.f});
     app.world.models.push_back(sphere);
 
+    auto light = std::make_shared<pw::world::point_light_t>();
+    light->position = pw::pos_t{2.f, 0.f, 2.f};
+    light->color = glm::vec3{0.2f, 0.4f, 1.f};
+    light->intensity = 8.f;
+    light->radius = 5.f;
+    app.world.lights.push_back(light);
+
     auto text_neko = std::make_shared<pw::ui::text2d_t>(400, 300, 32, "neko");
     app.ui.texts_2d.push_back(text_neko);
 
@@ -88,12 +115,30 @@ int main() {
         app.world.texts_3d.push_back(t);
     }
 
-    while (!app.should_close()) {
+    // caches and buffers have grown to their final size after the warm-up
+    constexpr int WARM_UP_STEPS = 300;
+    constexpr int MEASURED_STEPS = 300;
+    int n_steps = 0;
+    std::size_t allocations_before = 0;
+    int result = 0;
+    app.run([&](double) {
         text_inu->x += 1;
         for (int i = 0; i < vertices.size(); i++) {
             text_vertices[i]->pos = vertices[i];
         }
-        app.update();
-        app.draw();
-    }
+
+        n_steps++;
+        if (n_steps == WARM_UP_STEPS)
+            allocations_before = g_allocations.load();
+        if (n_steps == WARM_UP_STEPS + MEASURED_STEPS) {
+            auto n = g_allocations.load() - allocations_before;
+            if (n != 0) {
+                std::cerr << "heap allocations in " << MEASURED_STEPS
+                          << " steady-state steps: " << n << std::endl;
+                result = 1;
+            }
+            app.close();
+        }
+    });
+    return result;
 }
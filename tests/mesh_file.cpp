@@ -0,0 +1,180 @@
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <stdexcept>
+#include <string>
+#include <vector>
+#include <protowork/world/mesh_file.hpp>
+
+namespace pw = protowork;
+namespace mesh_file = protowork::world::mesh_file;
+
+// writes .pwm files and reads them back without a GL context; chunks are
+// only uploaded when a mapped model is drawn
+
+static int g_failures = 0;
+
+static void check(bool condition, std::string const &what) {
+    if (!condition) {
+        std::cerr << "failed: " << what << std::endl;
+        g_failures++;
+    }
+}
+
+static std::vector<char> read_file(std::string const &path) {
+    std::ifstream in{path, std::ios::binary};
+    return std::vector<char>{std::istreambuf_iterator<char>{in}, {}};
+}
+
+static void write_file(std::string const &path, std::vector<char> const &bytes,
+                       std::size_t size) {
+    std::ofstream out{path, std::ios::binary | std::ios::trunc};
+    out.write(bytes.data(), size);
+}
+
+// returns the reason mapping `path` failed with, empty when it succeeded
+static std::string map_error(std::string const &path) {
+    try {
+        pw::world::mapped_model_t model{path};
+    } catch (std::runtime_error const &e) {
+        return e.what();
+    }
+    return {};
+}
+
+static bool ends_with(std::string const &s, std::string const &suffix) {
+    return s.size() >= suffix.size() &&
+           s.compare(s.size() - suffix.size(), suffix.size(), suffix) == 0;
+}
+
+// a flat grid with more vertices than fit in one chunk
+struct grid_t {
+    static constexpr int N = 300;
+
+    std::vector<pw::pos_t> vertices;
+    std::vector<glm::vec3> normals;
+    std::vector<std::uint32_t> indices;
+
+    grid_t() {
+        for (int z = 0; z < N; z++) {
+            for (int x = 0; x < N; x++) {
+                vertices.push_back(pw::pos_t{float(x), 0.f, float(-z)});
+                normals.push_back(glm::vec3{0.f, 1.f, 0.f});
+            }
+        }
+        for (int z = 0; z + 1 < N; z++) {
+            for (int x = 0; x + 1 < N; x++) {
+                std::uint32_t i = z * N + x;
+                indices.insert(indices.end(),
+                               {i, i + 1, i + N, i + 1, i + N + 1, i + N});
+            }
+        }
+    }
+};
+
+static void check_round_trip(grid_t const &grid, std::string const &path,
+                             mesh_file::options_t options) {
+    std::string name = options.quantize ? "quantized: " : "plain: ";
+    mesh_file::write(path, grid.vertices, grid.normals, grid.indices, options);
+
+    auto bytes = read_file(path);
+    mesh_file::header_t header;
+    if (bytes.size() < sizeof(header)) {
+        check(false, name + "header written");
+        return;
+    }
+    std::memcpy(&header, bytes.data(), sizeof(header));
+    check(std::memcmp(header.magic, mesh_file::MAGIC,
+                      sizeof(mesh_file::MAGIC)) == 0,
+          name + "magic");
+    check(header.version == mesh_file::VERSION, name + "version");
+    check(((header.flags & mesh_file::QUANTIZED) != 0) == options.quantize,
+          name + "flags");
+    check(header.chunk_count >= 2, name + "split into chunks");
+    check(header.min[0] == 0.f && header.min[2] == 1.f - grid_t::N &&
+              header.max[0] == grid_t::N - 1.f && header.max[2] == 0.f,
+          name + "bounds");
+
+    std::vector<mesh_file::chunk_t> table(header.chunk_count);
+    if (bytes.size() < sizeof(header) + table.size() * sizeof(table[0])) {
+        check(false, name + "chunk table written");
+        return;
+    }
+    std::memcpy(table.data(), bytes.data() + sizeof(header),
+                table.size() * sizeof(table[0]));
+    std::size_t n_indices = 0;
+    for (auto const &chunk : table) {
+        check(chunk.vertex_count <= mesh_file::MAX_CHUNK_VERTICES,
+              name + "chunk vertex count");
+        check(chunk.offset % 16 == 0 && chunk.offset < bytes.size(),
+              name + "chunk offset");
+        n_indices += chunk.index_count;
+    }
+    check(n_indices == grid.indices.size(), name + "index count");
+
+    check(map_error(path).empty(), name + "mapped");
+    pw::world::mapped_model_t model{path};
+    auto bounds = model.compute_bounds();
+    check(bounds.min.x == header.min[0] && bounds.max.z == header.max[2],
+          name + "mapped bounds");
+    check(!model.is_resident(), name + "nothing uploaded before drawing");
+}
+
+static void check_rejections(std::string const &path,
+                             std::string const &broken) {
+    auto bytes = read_file(path);
+    mesh_file::header_t header;
+    std::memcpy(&header, bytes.data(), sizeof(header));
+
+    write_file(broken, bytes, sizeof(header) - 1);
+    check(ends_with(map_error(broken), "truncated header"),
+          "truncated header rejected");
+
+    write_file(broken, bytes, sizeof(header) + sizeof(mesh_file::chunk_t));
+    check(ends_with(map_error(broken), "truncated chunk table"),
+          "truncated chunk table rejected");
+
+    // the last chunk ends the file
+    write_file(broken, bytes, bytes.size() - 16);
+    check(ends_with(map_error(broken), "chunk out of bounds"),
+          "truncated chunk data rejected");
+
+    // an offset that overflows when the chunk size is added to it
+    auto corrupted = bytes;
+    std::uint64_t offset = UINT64_MAX & ~std::uint64_t{15};
+    std::memcpy(corrupted.data() + sizeof(header) +
+                    offsetof(mesh_file::chunk_t, offset),
+                &offset, sizeof(offset));
+    write_file(broken, corrupted, corrupted.size());
+    check(ends_with(map_error(broken), "chunk out of bounds"),
+          "overflowing chunk offset rejected");
+
+    corrupted = bytes;
+    corrupted[0] = 'X';
+    write_file(broken, corrupted, corrupted.size());
+    check(ends_with(map_error(broken), "not a protowork mesh"),
+          "bad magic rejected");
+}
+
+int main() {
+    auto dir = std::filesystem::temp_directory_path();
+    auto plain = (dir / "protowork_test_plain.pwm").string();
+    auto quantized = (dir / "protowork_test_quantized.pwm").string();
+    auto broken = (dir / "protowork_test_broken.pwm").string();
+
+    grid_t grid;
+    check_round_trip(grid, plain, {});
+    check_round_trip(grid, quantized, {.quantize = true});
+    if (g_failures == 0) {
+        check_rejections(plain, broken);
+        check_rejections(quantized, broken);
+    }
+
+    for (auto const &path : {plain, quantized, broken})
+        std::filesystem::remove(path);
+    return g_failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,171 @@
+#include <cmath>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <stdexcept>
+#include <string>
+#include <vector>
+#include <protowork/replay.hpp>
+
+namespace pw = protowork;
+
+// records input frames to a log and replays them without a window
+
+static int g_failures = 0;
+
+static void check(bool condition, std::string const &what) {
+    if (!condition) {
+        std::cerr << "failed: " << what << std::endl;
+        g_failures++;
+    }
+}
+
+using event_t = pw::event_t;
+
+static event_t move(double x, double y, double time) {
+    return event_t{event_t::kind_t::MOUSE_MOVE, event_t::action_t::RELEASE,
+                   0, 0, x, y, time};
+}
+
+static event_t button(int code, event_t::action_t action, double time) {
+    return event_t{event_t::kind_t::MOUSE_BUTTON, action, code, 0, 0.0, 0.0,
+                   time};
+}
+
+static event_t key(int code, event_t::action_t action, int mods,
+                   double time) {
+    return event_t{event_t::kind_t::KEY, action, code, mods, 0.0, 0.0, time};
+}
+
+static event_t scroll(double dy, double time) {
+    return event_t{event_t::kind_t::SCROLL, event_t::action_t::RELEASE, 0, 0,
+                   0.0, dy, time};
+}
+
+// events of each recorded frame; frame i is taken at 0.5 + i * 0.02
+// seconds, events arriving shortly before
+static std::vector<std::vector<event_t>> make_frames() {
+    using action_t = event_t::action_t;
+    constexpr int LEFT = pw::input_t::mouse_t::LEFT;
+    constexpr int KEY_W = 87;
+    return {
+        {move(10.0, 20.0, 0.495)},
+        {button(LEFT, action_t::PRESS, 0.511),
+         move(12.5, 21.0, 0.513), move(15.0, 22.0, 0.516)},
+        {},
+        {key(KEY_W, action_t::PRESS, 1, 0.551), scroll(-1.5, 0.552),
+         key(KEY_W, action_t::REPEAT, 1, 0.553)},
+        {button(LEFT, action_t::RELEASE, 0.575),
+         key(KEY_W, action_t::RELEASE, 0, 0.576)},
+        // a click within one frame
+        {button(LEFT, action_t::PRESS, 0.591),
+         button(LEFT, action_t::RELEASE, 0.592)},
+    };
+}
+
+static bool same_state(pw::input_t const &a, pw::input_t const &b) {
+    for (int i = 0; i < pw::input_t::mouse_t::N_BUTTONS; i++) {
+        if (a.mouse.buttons[i] != b.mouse.buttons[i])
+            return false;
+    }
+    for (int i = 0; i < pw::input_t::keyboard_t::N_KEYS; i++) {
+        if (a.keyboard.keys[i] != b.keyboard.keys[i])
+            return false;
+    }
+    return a.mouse.x == b.mouse.x && a.mouse.y == b.mouse.y &&
+           a.mouse.scroll_x == b.mouse.scroll_x &&
+           a.mouse.scroll_y == b.mouse.scroll_y;
+}
+
+static bool same_event(event_t const &a, event_t const &b) {
+    return a.kind == b.kind && a.action == b.action && a.code == b.code &&
+           a.mods == b.mods && a.x == b.x && a.y == b.y;
+}
+
+int main() {
+    auto dir = std::filesystem::temp_directory_path();
+    auto path = (dir / "protowork_test_input.log").string();
+    auto broken = (dir / "protowork_test_broken.log").string();
+
+    constexpr double STEP = 1.0 / 60.0;
+    auto frames = make_frames();
+
+    // the states the recording session saw at the end of each frame
+    std::vector<pw::input_t> recorded;
+    pw::input_t input;
+    input.mouse.x = 400.0;
+    input.mouse.y = 300.0;
+    {
+        pw::input_recorder_t recorder{path, input};
+        for (std::size_t i = 0; i < frames.size(); i++) {
+            input.begin_frame();
+            input.time = 0.5 + i * 0.02;
+            for (auto const &event : frames[i])
+                input.apply(event);
+            recorder.record(input);
+            recorded.push_back(input);
+        }
+    }
+
+    pw::input_t replayed;
+    pw::input_player_t player{path, replayed, STEP};
+    check(replayed.mouse.x == 400.0 && replayed.mouse.y == 300.0,
+          "initial mouse position");
+    for (std::size_t i = 0; i < frames.size(); i++) {
+        auto frame = "frame " + std::to_string(i) + ": ";
+        if (!player.next(replayed)) {
+            check(false, frame + "replayed");
+            break;
+        }
+        auto const &expected = recorded[i];
+        check(replayed.time == i * STEP, frame + "fixed timestep");
+        check(same_state(replayed, expected), frame + "mouse and keys");
+        if (replayed.events.size() != expected.events.size()) {
+            check(false, frame + "event count");
+            continue;
+        }
+        for (std::size_t j = 0; j < expected.events.size(); j++) {
+            auto const &event = replayed.events[j];
+            check(same_event(event, expected.events[j]), frame + "event");
+            // offsets to the frame are kept
+            check(std::abs((event.time - replayed.time) -
+                           (expected.events[j].time - expected.time)) < 1e-9,
+                  frame + "event time");
+        }
+    }
+    check(player.frame() == frames.size(), "frame count");
+    check(!player.next(replayed), "end of log");
+    check(replayed.events.empty(), "no events after the end");
+
+    // a log cut within a frame ends before it
+    {
+        std::ifstream in{path, std::ios::binary};
+        std::vector<char> bytes{std::istreambuf_iterator<char>{in}, {}};
+        std::ofstream out{broken, std::ios::binary | std::ios::trunc};
+        out.write(bytes.data(), bytes.size() - 4);
+    }
+    {
+        pw::input_t truncated;
+        pw::input_player_t truncated_player{broken, truncated, STEP};
+        while (truncated_player.next(truncated)) {
+        }
+        check(truncated_player.frame() == frames.size() - 1,
+              "truncated log ends before its last frame");
+    }
+
+    {
+        std::ofstream out{broken, std::ios::binary | std::ios::trunc};
+        out << "not an input log at all";
+    }
+    try {
+        pw::input_t other;
+        pw::input_player_t other_player{broken, other, STEP};
+        check(false, "foreign file rejected");
+    } catch (std::runtime_error const &) {
+    }
+
+    std::filesystem::remove(path);
+    std::filesystem::remove(broken);
+    return g_failures == 0 ? 0 : 1;
+}